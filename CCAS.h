@@ -1,5 +1,8 @@
+#pragma once
 #include <atomic>
 #include "defines.h"
+#include "Reclaimer.h"
+#include "Stats.h"
 
 using namespace std;
 
@@ -10,6 +13,9 @@ enum STATUS
     SUCCEEDED=2
 };
 
+//Hazard pointer slots used while helping descriptors (slots below are left to the data structures)
+#define HP_CCAS_SLOT (HP_SLOTS-1)
+
 class CCAS{
 private:
     typedef struct CCASDESCRIPTOR{
@@ -19,38 +25,51 @@ private:
         CCASDESCRIPTOR(int64 *_a, int64 _e, int64 _n, STATUS *_cond) 
                 : a(_a), e(_e), n(_n), cond(_cond) {}
     }CCASDesc;
+    Reclaimer *reclaimer;
 
 public:
-    CCAS();
+    CCAS(Reclaimer *_reclaimer);
     ~CCAS();
 
     bool IsCCASDesc(int64 d);
-    void doCCAS(int64 *a, int64 e, int64 n, STATUS *cond);
-    int64 CCASRead(int64 *a);
+    void doCCAS(const int tid, int64 *a, int64 e, int64 n, STATUS *cond);
+    int64 CCASRead(const int tid, int64 *a);
+    //Expected value of the descriptor d, which stands for it until it is resolved
+    int64 CCASExpected(int64 d) { return ((CCASDesc *)(d & (~2)))->e; }
     void CCASHelp(CCASDesc *d);
 };
 
-CCAS::CCAS(){
+CCAS::CCAS(Reclaimer *_reclaimer) : reclaimer(_reclaimer){
 }
 
 CCAS::~CCAS(){
 }
 
-void CCAS::doCCAS(int64 *a, int64 e, int64 n, STATUS *cond){
-    CCASDesc *d = new CCASDesc(a,e,n,cond);
-    bool v = __sync_bool_compare_and_swap(d->a,d->e,((int64)d)|2);
-    while(!v){
-        if(!IsCCASDesc(v)) return;
-        CCASHelp((CCASDesc *)v);
-        v = __sync_val_compare_and_swap(d->a,d->e,((int64)d)|2);
+void CCAS::doCCAS(const int tid, int64 *a, int64 e, int64 n, STATUS *cond){
+    CCASDesc *d = allocObject<CCASDesc>(tid,a,e,n,cond);
+    int64 desc = ((int64)d)|2;
+    int64 v = __sync_val_compare_and_swap(d->a,d->e,desc);
+    while(v != d->e){
+        if(!IsCCASDesc(v)){
+            freeObject(tid, d);   //never published
+            return;
+        }
+        STAT_INC(tid, CCAS_HELPS);
+        reclaimer->protect(tid, HP_CCAS_SLOT, (void *)(v & (~2)));
+        if(*a == v) CCASHelp((CCASDesc *)v);
+        v = __sync_val_compare_and_swap(d->a,d->e,desc);
     }
-    CCASHelp(d);
+    CCASHelp((CCASDesc *)desc);
+    reclaimer->retire(tid, d);
 }
 
-int64 CCAS::CCASRead (int64 *a){
+int64 CCAS::CCASRead (const int tid, int64 *a){
     int64 v;
-    for(v = *a; IsCCASDesc(v); v = *a)
-        CCASHelp((CCASDesc *)v);
+    for(v = *a; IsCCASDesc(v); v = *a){
+        STAT_INC(tid, CCAS_HELPS);
+        reclaimer->protect(tid, HP_CCAS_SLOT, (void *)(v & (~2)));
+        if(*a == v) CCASHelp((CCASDesc *)v);
+    }
     return v;
 }
 
@@ -63,4 +82,4 @@ void CCAS::CCASHelp(CCASDesc *d){
 
 bool CCAS::IsCCASDesc(int64 d){
     return (int64)d & 2;
-}
\ No newline at end of file
+}
@@ -0,0 +1,154 @@
+#pragma once
+#include <atomic>
+
+#include "defines.h"
+#include "util.h"
+#include "KeyTraits.h"
+#include "Stats.h"
+
+using namespace std;
+
+/*
+ * Elimination array for same-key updates, built with -DUSE_ELIMINATION. An operation on key k
+ * first visits slot hash(k). If another thread's offer is waiting there, it claims the offer and
+ * completes both operations with at most one operation on the list:
+ *   insertOrUpdate + insertOrUpdate  the claimer's insert is applied; the waiter is linearized
+ *                                    just before it and gets its result, the claimer reports an
+ *                                    update (false), so the claimer's value is the final one
+ *   erase + erase                    one erase is applied; the waiter gets its result, the
+ *                                    claimer is linearized just after it and reports false
+ *   insertOrUpdate + erase           if k is absent when the claimer checks, the insert and the
+ *                                    erase are linearized back to back at that moment and both
+ *                                    return true without touching the list; otherwise both
+ *                                    proceed on their own
+ * Both operations are in progress while the claimer works, so the linearization points lie
+ * inside both intervals. A claimed waiter blocks until its claimer finishes, as in flat combining,
+ * so the layer trades lock-freedom for fewer updates to hot nodes. If the slot is empty the thread publishes its own offer and spins
+ * briefly for a partner. The spin budget adapts per thread: it doubles when an offer is taken
+ * and halves when it times out, dropping to zero below ELIMINATION_MIN_SPINS. At zero the thread
+ * only publishes one operation in ELIMINATION_PROBE, so uniform workloads pay about one load
+ * per operation.
+ * apply(op, value) runs op on key in the list itself and returns its result; for ELIM_PRESENT it
+ * returns whether key is in the list.
+ */
+
+#ifndef ELIMINATION_SLOTS
+#define ELIMINATION_SLOTS 1024          //power of two
+#endif
+#define ELIMINATION_MAX_SPINS 512
+#define ELIMINATION_MIN_SPINS 16
+#define ELIMINATION_PROBE 64
+
+enum ElimOp { ELIM_INSERT = 0, ELIM_ERASE = 1, ELIM_PRESENT = 2 };
+
+template <class Key, class Value, class Compare = less<Key>>
+class EliminationArray {
+private:
+    typedef KeyTraits<Key, Compare> KT;
+    enum { WAITING = 0, RESULT_FALSE = 1, RESULT_TRUE = 2, REJECTED = 3 };
+    struct Offer {
+        volatile char padding0[PADDING_BYTES];
+        Key key;
+        Value value;
+        int op;
+        atomic<int> status;
+        int spins;              //owner's adaptive spin budget
+        int untilProbe;
+        volatile char padding1[PADDING_BYTES];
+    };
+    struct Slot {
+        volatile char padding[PADDING_BYTES-sizeof(atomic<Offer *>)];
+        atomic<Offer *> offer;
+    };
+    Slot slots[ELIMINATION_SLOTS];
+    Offer offers[MAX_THREADS];
+
+    static int slotOf(const Key & key) {
+        return (int)(((uint64_t)KT::checksum(key) * 0x9E3779B97F4A7C15ULL) >> 32) & (ELIMINATION_SLOTS-1);
+    }
+    template <class Apply> bool take(const int tid, Slot & slot, Offer *other, const int op, const Key & key, const Value & value, bool & result, Apply apply);
+    bool wait(const int tid, Offer & mine, Slot & slot, bool & result);
+
+public:
+    EliminationArray();
+
+    //True if op was completed by elimination, with its return value in result
+    template <class Apply> bool exchange(const int tid, const int op, const Key & key, const Value & value, bool & result, Apply apply);
+};
+
+template <class Key, class Value, class Compare>
+EliminationArray<Key, Value, Compare>::EliminationArray(){
+    for(int i = 0; i < ELIMINATION_SLOTS; i++) slots[i].offer.store(NULL, MOR);
+    for(int tid = 0; tid < MAX_THREADS; tid++){
+        offers[tid].status.store(WAITING, MOR);
+        offers[tid].spins = ELIMINATION_MAX_SPINS/8;
+        offers[tid].untilProbe = ELIMINATION_PROBE;
+    }
+}
+
+template <class Key, class Value, class Compare>
+template <class Apply>
+bool EliminationArray<Key, Value, Compare>::exchange(const int tid, const int op, const Key & key, const Value & value, bool & result, Apply apply){
+    Slot & slot = slots[slotOf(key)];
+    Offer *other = slot.offer.load(memory_order_acquire);
+    if(other != NULL) return take(tid, slot, other, op, key, value, result, apply);
+    Offer & mine = offers[tid];
+    if(mine.spins == 0){
+        if(--mine.untilProbe > 0) return false;
+        mine.untilProbe = ELIMINATION_PROBE;
+        mine.spins = ELIMINATION_MIN_SPINS;
+    }
+    mine.key = key;
+    mine.value = value;
+    mine.op = op;
+    mine.status.store(WAITING, MOR);
+    Offer *expected = NULL;
+    if(!slot.offer.compare_exchange_strong(expected, &mine, memory_order_acq_rel)) return false;
+    return wait(tid, mine, slot, result);
+}
+
+//Claims other; its owner then waits until the status says what to do
+template <class Key, class Value, class Compare>
+template <class Apply>
+bool EliminationArray<Key, Value, Compare>::take(const int tid, Slot & slot, Offer *other, const int op, const Key & key, const Value & value, bool & result, Apply apply){
+    if(other == &offers[tid]) return false;
+    if(!slot.offer.compare_exchange_strong(other, NULL, memory_order_acq_rel)) return false;
+    if(!KT::equal(other->key, key)){
+        other->status.store(REJECTED, memory_order_release);
+        return false;
+    }
+    if(other->op == op){
+        bool r = apply(op, value);
+        other->status.store(r ? RESULT_TRUE : RESULT_FALSE, memory_order_release);
+        result = false;
+    }else{
+        if(apply(ELIM_PRESENT, value)){
+            other->status.store(REJECTED, memory_order_release);
+            return false;
+        }
+        other->status.store(RESULT_TRUE, memory_order_release);
+        result = true;
+    }
+    STAT_INC(tid, ELIMINATIONS);
+    return true;
+}
+
+template <class Key, class Value, class Compare>
+bool EliminationArray<Key, Value, Compare>::wait(const int tid, Offer & mine, Slot & slot, bool & result){
+    for(int i = 0; i < mine.spins && mine.status.load(memory_order_acquire) == WAITING; i++){
+        cpuRelax();
+    }
+    Offer *expected = &mine;
+    if(mine.status.load(memory_order_acquire) == WAITING && slot.offer.compare_exchange_strong(expected, NULL, memory_order_acq_rel)){
+        mine.spins = (mine.spins < 2*ELIMINATION_MIN_SPINS) ? 0 : mine.spins/2;       //nobody came
+        return false;
+    }
+    //Claimed: the claimer always finishes with a status
+    int s;
+    while((s = mine.status.load(memory_order_acquire)) == WAITING){}
+    if(s == REJECTED) return false;
+    mine.spins = min(ELIMINATION_MAX_SPINS, 2*mine.spins + 1);
+    result = (s == RESULT_TRUE);
+    STAT_INC(tid, ELIMINATIONS);
+    return true;
+}
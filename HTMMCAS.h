@@ -0,0 +1,110 @@
+#pragma once
+#include "defines.h"
+#include "MCAS.h"
+#include "Stats.h"
+#if (defined(__x86_64__) || defined(__i386__)) && !defined(NO_HTM)
+#include <cpuid.h>
+#include <immintrin.h>
+#define HTM_SUPPORTED
+#endif
+
+using namespace std;
+
+/*
+ * MCAS that first applies the whole update inside an Intel RTM transaction and falls back to the
+ * descriptor-based MCAS it extends. Inside the transaction every word must hold a plain value: a
+ * word owned by a software MCAS or CCAS aborts the transaction explicitly and the fallback helps
+ * it. The transaction reads every word before writing any, so a descriptor installed by a
+ * concurrent software MCAS aborts it, and a committed transaction is one atomic step to the
+ * descriptor path. A plain mismatch commits without writes and fails the MCAS at that read.
+ * RTM is detected once with cpuid. Without it (or built with -DNO_HTM), after HTM_RETRIES aborts,
+ * or after an abort that retrying will not fix, the update goes through MCAS::doMCAS. Single
+ * words always do, since a plain CAS is already one instruction. Commits, aborts by reason and
+ * fallbacks are counted in Stats.
+ */
+
+#ifndef HTM_RETRIES
+#define HTM_RETRIES 4
+#endif
+#define HTM_ABORT_DESCRIPTOR 0xd1
+
+#ifdef HTM_SUPPORTED
+//_XBEGIN_STARTED once the transaction committed, with the MCAS result in result; otherwise the
+//abort status
+__attribute__((target("rtm")))
+inline unsigned htmTryMCAS(int64 *a[], int64 e[], int64 n[], const int N, bool & result){
+    unsigned status = _xbegin();
+    if(status != _XBEGIN_STARTED) return status;
+    for(int i = 0; i < N; i++){
+        int64 v = *(volatile int64 *)a[i];
+        if(v & 3) _xabort(HTM_ABORT_DESCRIPTOR);       //MCAS (1) or CCAS (2) descriptor
+        if(v != e[i]<<2){
+            _xend();
+            result = false;
+            return _XBEGIN_STARTED;
+        }
+    }
+    for(int i = 0; i < N; i++) *(volatile int64 *)a[i] = n[i]<<2;
+    _xend();
+    result = true;
+    return _XBEGIN_STARTED;
+}
+#endif
+
+class HTMMCAS : public MCAS {
+public:
+    const bool useHTM;
+
+    HTMMCAS(Reclaimer *_reclaimer);
+
+    static bool rtmAvailable();
+    bool doMCAS(const int tid, int64 *a[], int64 e[], int64 n[], int N);
+};
+
+HTMMCAS::HTMMCAS(Reclaimer *_reclaimer) : MCAS(_reclaimer), useHTM(rtmAvailable()) {}
+
+bool HTMMCAS::rtmAvailable(){
+#ifdef HTM_SUPPORTED
+    static const bool available = [](){
+        unsigned eax, ebx, ecx, edx;
+        if(!__get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx)) return false;
+        return (ebx & bit_RTM) != 0;
+    }();
+    return available;
+#else
+    return false;
+#endif
+}
+
+bool HTMMCAS::doMCAS(const int tid, int64 *a[], int64 e[], int64 n[], int N){
+#ifdef HTM_SUPPORTED
+    if(useHTM && N > 1){
+        for(int attempt = 0; attempt < HTM_RETRIES; attempt++){
+            bool result = false;
+            unsigned status = htmTryMCAS(a, e, n, N, result);
+            if(status == _XBEGIN_STARTED){
+                STAT_INC(tid, HTM_COMMITS);
+                STAT_INC(tid, MCAS_OPS);
+                if(!result) STAT_INC(tid, MCAS_FAILURES);
+                return result;
+            }
+            if((status & _XABORT_EXPLICIT) && _XABORT_CODE(status) == HTM_ABORT_DESCRIPTOR){
+                STAT_INC(tid, HTM_DESCRIPTOR_ABORTS);
+                break;
+            }
+            if(status & _XABORT_CAPACITY){
+                STAT_INC(tid, HTM_CAPACITY_ABORTS);
+                break;
+            }
+            if(status & _XABORT_CONFLICT){
+                STAT_INC(tid, HTM_CONFLICT_ABORTS);
+                continue;
+            }
+            STAT_INC(tid, HTM_OTHER_ABORTS);
+            if(!(status & _XABORT_RETRY)) break;
+        }
+        STAT_INC(tid, HTM_FALLBACKS);
+    }
+#endif
+    return MCAS::doMCAS(tid, a, e, n, N);
+}
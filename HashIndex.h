@@ -0,0 +1,126 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+
+#include "defines.h"
+#include "KeyTraits.h"
+
+using namespace std;
+
+/*
+ * Lock-free hash index from keys to the nodes of a list, built with -DUSE_HASH_INDEX. Open
+ * addressing with linear probing over an array of node pointers; a slot is NULL until it is first
+ * used and TOMB once its node has been removed, so a probe for a key stops at the first NULL or
+ * after HASH_INDEX_PROBES slots. Several slots may hold nodes with the same key: the list decides
+ * which of them is live, and find returns the first one its caller accepts. The index is only a
+ * shortcut for keys it finds; a node that did not fit within HASH_INDEX_PROBES slots is simply
+ * not indexed and is found through the list instead.
+ * The owner publishes a node once it is reachable and removes it before retiring it, so a node
+ * read from a slot inside a Guard stays valid while the Guard is held.
+ */
+
+#ifndef HASH_INDEX_SLOTS
+#define HASH_INDEX_SLOTS (1<<20)        //power of two; owners grow it to twice the keys they expect
+#endif
+#ifndef HASH_INDEX_PROBES
+#define HASH_INDEX_PROBES 32
+#endif
+
+template <class Key, class Node, class Compare = less<Key>>
+class HashIndex {
+private:
+    typedef KeyTraits<Key, Compare> KT;
+    volatile char padding0[PADDING_BYTES];
+    atomic<Node *> *slots;
+    size_t mask;
+    volatile char padding1[PADDING_BYTES];
+
+    static Node *tomb() { return (Node *)(uintptr_t)1; }
+    size_t slotOf(const Key & key) const {
+        return (size_t)(((uint64_t)KT::checksum(key) * 0x9E3779B97F4A7C15ULL) >> 20) & mask;
+    }
+    void allocate(const size_t capacity);
+
+public:
+    HashIndex();
+    ~HashIndex();
+
+    //Grows the table to at least capacity slots; only while no other thread uses the index
+    void reserve(const size_t capacity);
+    //First indexed node with key for which live(node) holds, NULL if none
+    template <class Live> Node *find(const Key & key, Live live);
+    //False if every slot within HASH_INDEX_PROBES was in use
+    bool publish(Node *n);
+    void remove(Node *n);
+};
+
+template <class Key, class Node, class Compare>
+HashIndex<Key, Node, Compare>::HashIndex() : slots(NULL) {
+    allocate(HASH_INDEX_SLOTS);
+}
+
+template <class Key, class Node, class Compare>
+HashIndex<Key, Node, Compare>::~HashIndex(){
+    delete[] slots;
+}
+
+template <class Key, class Node, class Compare>
+void HashIndex<Key, Node, Compare>::allocate(const size_t capacity){
+    size_t n = 1;
+    while(n < capacity) n <<= 1;
+    delete[] slots;
+    slots = new atomic<Node *>[n];
+    for(size_t i = 0; i < n; i++) slots[i].store(NULL, MOR);
+    mask = n - 1;
+}
+
+template <class Key, class Node, class Compare>
+void HashIndex<Key, Node, Compare>::reserve(const size_t capacity){
+    if(capacity <= mask + 1) return;
+    atomic<Node *> *old = slots;
+    size_t oldSize = mask + 1;
+    slots = NULL;
+    allocate(capacity);
+    for(size_t i = 0; i < oldSize; i++){
+        Node *n = old[i].load(MOR);
+        if(n != NULL && n != tomb()) publish(n);
+    }
+    delete[] old;
+}
+
+template <class Key, class Node, class Compare>
+template <class Live>
+Node *HashIndex<Key, Node, Compare>::find(const Key & key, Live live){
+    size_t s = slotOf(key);
+    for(int i = 0; i < HASH_INDEX_PROBES; i++, s = (s+1) & mask){
+        Node *n = slots[s].load(memory_order_acquire);
+        if(n == NULL) return NULL;
+        if(n != tomb() && KT::equal(n->key, key) && live(n)) return n;
+    }
+    return NULL;
+}
+
+template <class Key, class Node, class Compare>
+bool HashIndex<Key, Node, Compare>::publish(Node *n){
+    size_t s = slotOf(n->key);
+    for(int i = 0; i < HASH_INDEX_PROBES; i++, s = (s+1) & mask){
+        Node *curr = slots[s].load(MOR);
+        while(curr == NULL || curr == tomb()){
+            if(slots[s].compare_exchange_weak(curr, n, memory_order_release, MOR)) return true;
+        }
+    }
+    return false;
+}
+
+template <class Key, class Node, class Compare>
+void HashIndex<Key, Node, Compare>::remove(Node *n){
+    size_t s = slotOf(n->key);
+    for(int i = 0; i < HASH_INDEX_PROBES; i++, s = (s+1) & mask){
+        Node *curr = slots[s].load(MOR);
+        if(curr == NULL) return;
+        if(curr == n){
+            slots[s].store(tomb(), memory_order_release);
+            return;
+        }
+    }
+}
@@ -0,0 +1,140 @@
+#pragma once
+#include <cstring>
+#include <limits>
+#include <functional>
+#include <type_traits>
+
+#include "defines.h"
+#include "Pool.h"
+#include "Reclaimer.h"
+
+using namespace std;
+
+/*
+ * Compile-time key and value handling for the templated skip lists.
+ * KeyTraits<Key, Compare> supplies the head/tail sentinels and the comparisons used during
+ * traversal. Integral keys ordered by less<> or greater<> get a specialization that compares
+ * with plain < and == and reserves the extreme values of the type as sentinels, so int keys
+ * compile to the same code as before. Other key types provide Key::minKey()/maxKey() (see
+ * FixedString) or specialize KeyTraits themselves.
+ * scanKey maps a key to an int64 in the same order, for ScanVersions striping, and checksum
+ * folds it into a long for validation.
+ * ValueCodec<Value> stores a value in one word that a CAS or MCAS can replace: trivially
+ * copyable values of up to 4 bytes are held inline, anything else is boxed in an immutable
+ * copy that is retired when the value is replaced.
+ */
+
+template <class Key, class Compare = less<Key>, class Enable = void>
+struct KeyTraits {
+    static Key minKey() { return Key::minKey(); }
+    static Key maxKey() { return Key::maxKey(); }
+    static bool less(const Key & a, const Key & b) { return Compare()(a, b); }
+    static bool lessEq(const Key & a, const Key & b) { return !Compare()(b, a); }
+    static bool equal(const Key & a, const Key & b) { return !Compare()(a, b) && !Compare()(b, a); }
+    static int64 scanKey(const Key & k) { return k.scanKey(); }
+    static long checksum(const Key & k) { return k.checksum(); }
+};
+
+template <class Key>
+struct KeyTraits<Key, less<Key>, typename enable_if<is_integral<Key>::value>::type> {
+    static Key minKey() { return numeric_limits<Key>::min(); }
+    static Key maxKey() { return numeric_limits<Key>::max(); }
+    static bool less(const Key & a, const Key & b) { return a < b; }
+    static bool lessEq(const Key & a, const Key & b) { return a <= b; }
+    static bool equal(const Key & a, const Key & b) { return a == b; }
+    static int64 scanKey(const Key & k) {
+        return is_signed<Key>::value ? (int64)k : (int64)((uint64_t)k ^ (1ULL<<63));
+    }
+    static long checksum(const Key & k) { return (long)k; }
+};
+
+template <class Key>
+struct KeyTraits<Key, greater<Key>, typename enable_if<is_integral<Key>::value>::type> {
+    static Key minKey() { return numeric_limits<Key>::max(); }
+    static Key maxKey() { return numeric_limits<Key>::min(); }
+    static bool less(const Key & a, const Key & b) { return a > b; }
+    static bool lessEq(const Key & a, const Key & b) { return a >= b; }
+    static bool equal(const Key & a, const Key & b) { return a == b; }
+    static int64 scanKey(const Key & k) { return ~KeyTraits<Key, std::less<Key>>::scanKey(k); }
+    static long checksum(const Key & k) { return (long)k; }
+};
+
+//Fixed-length byte string key compared like memcmp; all-zero and all-0xff are reserved as sentinels
+template <int N>
+struct FixedString {
+    unsigned char bytes[N];
+
+    FixedString() { memset(bytes, 0, N); }
+    FixedString(const char *s) {
+        memset(bytes, 0, N);
+        memcpy(bytes, s, strnlen(s, N));
+    }
+    static FixedString minKey() { return FixedString(); }
+    static FixedString maxKey() {
+        FixedString k;
+        memset(k.bytes, 0xff, N);
+        return k;
+    }
+    bool operator<(const FixedString & o) const { return memcmp(bytes, o.bytes, N) < 0; }
+    bool operator==(const FixedString & o) const { return memcmp(bytes, o.bytes, N) == 0; }
+    //First 8 bytes big-endian, flipped so that unsigned byte order becomes signed order
+    int64 scanKey() const {
+        uint64_t v = 0;
+        for(int i = 0; i < 8; i++) v = (v<<8) | (i < N ? bytes[i] : 0);
+        return (int64)(v ^ (1ULL<<63));
+    }
+    long checksum() const {
+        uint32_t h = 2166136261u;
+        for(int i = 0; i < N; i++) h = (h ^ bytes[i]) * 16777619u;
+        return (long)h;
+    }
+};
+
+template <int N>
+struct KeyTraits<FixedString<N>, less<FixedString<N>>> {
+    typedef FixedString<N> Key;
+    static Key minKey() { return Key::minKey(); }
+    static Key maxKey() { return Key::maxKey(); }
+    static bool less(const Key & a, const Key & b) { return memcmp(a.bytes, b.bytes, N) < 0; }
+    static bool lessEq(const Key & a, const Key & b) { return memcmp(a.bytes, b.bytes, N) <= 0; }
+    static bool equal(const Key & a, const Key & b) { return memcmp(a.bytes, b.bytes, N) == 0; }
+    static int64 scanKey(const Key & k) { return k.scanKey(); }
+    static long checksum(const Key & k) { return k.checksum(); }
+};
+
+//Boxed values: the word is a pointer to an immutable copy
+template <class Value, class Enable = void>
+struct ValueCodec {
+    static const bool boxed = true;
+    static int64 encode(const int tid, const Value & v) { return (int64)(uintptr_t)allocObject<Value>(tid, v); }
+    static Value decode(const int64 w) { return *(Value *)(uintptr_t)w; }
+    static Value absent() { return Value(); }
+    //w was replaced and may still be read by concurrent operations
+    static void release(const int tid, Reclaimer *reclaimer, const int64 w) { if(w != 0) reclaimer->retire(tid, (Value *)(uintptr_t)w); }
+    //w was never visible to other threads, or its owner is being destroyed
+    static void discard(const int tid, const int64 w) { if(w != 0) freeObject(tid, (Value *)(uintptr_t)w); }
+};
+
+//Inline values: the bytes themselves, zero-extended, so they survive the MCAS shift by two
+template <class Value>
+struct ValueCodec<Value, typename enable_if<is_trivially_copyable<Value>::value && sizeof(Value) <= 4>::type> {
+    static const bool boxed = false;
+    static int64 encode(const int tid, const Value & v) {
+        uint32_t bits = 0;
+        memcpy(&bits, &v, sizeof(Value));
+        return (int64)bits;
+    }
+    static Value decode(const int64 w) {
+        uint32_t bits = (uint32_t)w;
+        Value v;
+        memcpy(&v, &bits, sizeof(Value));
+        return v;
+    }
+    static Value absent() { return absentValue<Value>(); }
+    static void release(const int tid, Reclaimer *reclaimer, const int64 w) {}
+    static void discard(const int tid, const int64 w) {}
+
+private:
+    template <class V> static typename enable_if<is_integral<V>::value, V>::type absentValue() { return numeric_limits<V>::min(); }
+    template <class V> static typename enable_if<!is_integral<V>::value, V>::type absentValue() { return V(); }
+};
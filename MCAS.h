@@ -1,100 +1,165 @@
+#pragma once
 #include <atomic>
 #include "defines.h"
 #include "CCAS.h"
+#include "Reclaimer.h"
 
 using namespace std;
 
 class MCAS{
 public:
+    struct MCASEntry{
+        int64 *a;           //Address to perform CAS on
+        int64 e, n;         //Expected value and new value at that address
+    };
+    //Allocated with room for exactly N entries, so a two-word update does not pay for the
+    //2*NR_LEVELS+1 words the tallest tower could need
     struct MCASDesc{
         int N;
-        int64 *a[2*NR_LEVELS+1];   //Arrary of addresses to perform CAS on
-        int64 e[2*NR_LEVELS+1], n[2*NR_LEVELS+1];  //Expected values and new values at those addresses
         STATUS status;  // Status of CAS
-        MCASDesc() : status(UNDECIDED){
-            
-        }
-    };//__attribute__((aligned(PADDING_BYTES)));
+        MCASEntry entries[];
+    };
     volatile char padding0[PADDING_BYTES];
     CCAS *Ccas;
+    Reclaimer *reclaimer;
     volatile char padding1[PADDING_BYTES];
 
-    MCAS();
+    MCAS(Reclaimer *_reclaimer);
     ~MCAS();
 
+    static size_t descBytes(const int N) { return sizeof(MCASDesc) + N*sizeof(MCASEntry); }
+    static void destroyDesc(const int tid, void *p);
     bool IsMCASDesc(int64 d);
-    void AddressSort(MCASDesc *d);
-    bool doMCAS(int64 *a[], int64 e[], int64 n[], int N);
-    int64 MCASRead(int64 *a);
-    bool MCASHelp(MCASDesc *d);
+    bool doCAS(const int tid, int64 *a, int64 e, int64 n);
+    bool doMCAS(const int tid, int64 *a[], int64 e[], int64 n[], int N);
+    int64 MCASRead(const int tid, int64 *a);
+    //Logical value of *a without helping or writing to shared memory
+    int64 MCASReadNoHelp(const int tid, int64 *a);
+    bool MCASHelp(const int tid, MCASDesc *d);
     //Read and write should be performed through MCAS. Because regular value is right shifted two paces. Descriptor can also be helped.
     void valueWrite(int64 *a, int64 b);
     void valueWriteInt(int64 *a, int64 b);
-    int64 valueRead(int64 *a);
+    int64 valueRead(const int tid, int64 *a);
+    int64 valueReadNoHelp(const int tid, int64 *a);
 };
 
-MCAS::MCAS(){
-    Ccas= new CCAS();
+//Hazard pointer slot used while helping another MCAS
+#define HP_MCAS_SLOT (HP_SLOTS-2)
+
+MCAS::MCAS(Reclaimer *_reclaimer) : reclaimer(_reclaimer){
+    Ccas= new CCAS(_reclaimer);
 }
 
 MCAS::~MCAS(){
     delete Ccas;
 }
 
-bool MCAS::doMCAS(int64 *a[], int64 e[], int64 n[], int N){
-    MCASDesc *d = new MCASDesc();
-    for(int i = 0; i<N; i++){
-        d->a[i]=a[i];
-        d->e[i]=e[i]<<2;
-        d->n[i]=n[i]<<2;
+//A single word needs no descriptor: a plain CAS fails on a word that holds one, which is then
+//helped out of the way before retrying
+bool MCAS::doCAS(const int tid, int64 *a, int64 e, int64 n){
+    STAT_INC(tid, MCAS_OPS);
+    while(true){
+        int64 v = __sync_val_compare_and_swap(a, e, n);
+        if(v == e) return true;
+        if(!IsMCASDesc(v) && !Ccas->IsCCASDesc(v)){
+            STAT_INC(tid, MCAS_FAILURES);
+            return false;
+        }
+        MCASRead(tid, a);
     }
-    d->N = N;    
-    AddressSort(d);
-    return MCASHelp(d);
 }
 
-//Sort all the addresses in the MCAS using bubble sort
-void MCAS::AddressSort(MCASDesc *d){
-    for(int i = 0; i < d->N; i++){
-        for (int j = i+1; j < d->N; j++){
-            if((int64)d->a[i] > (int64)d->a[j]){
-                int64 *temp = d->a[i];
-                int64 Exp_temp = d->e[i];
-                int64 New_temp = d->n[i];
-
-                d->a[i] = d->a[j];
-                d->e[i] = d->e[j];
-                d->n[i] = d->n[j];
-
-                d->a[j] = temp;
-                d->e[j] = Exp_temp;
-                d->n[j] = New_temp;
-            }
+bool MCAS::doMCAS(const int tid, int64 *a[], int64 e[], int64 n[], int N){
+    if(N == 1) return doCAS(tid, a[0], e[0]<<2, n[0]<<2);
+    //A word that already holds another plain value fails the MCAS before a descriptor is built;
+    //the read is its linearization point
+    for(int i = 0; i < N; i++){
+        int64 v = *(volatile int64 *)a[i];
+        if(!IsMCASDesc(v) && !Ccas->IsCCASDesc(v) && v != e[i]<<2){
+            STAT_INC(tid, MCAS_OPS);
+            STAT_INC(tid, MCAS_FAILURES);
+            return false;
         }
     }
+    MCASDesc *d = (MCASDesc *)allocBytes(tid, descBytes(N));
+    //Keep entries sorted by address as they are added
+    for(int i = 0; i < N; i++){
+        int j = i;
+        for(; j > 0 && (int64)d->entries[j-1].a > (int64)a[i]; j--) d->entries[j] = d->entries[j-1];
+        d->entries[j].a = a[i];
+        d->entries[j].e = e[i]<<2;
+        d->entries[j].n = n[i]<<2;
+    }
+    d->N = N;
+    d->status = UNDECIDED;
+    bool result = MCASHelp(tid, d);
+    STAT_INC(tid, MCAS_OPS);
+    if(!result) STAT_INC(tid, MCAS_FAILURES);
+    //Every word has been released by the loop at the end of MCASHelp; helpers may still hold d
+    reclaimer->retire(tid, d, destroyDesc);
+    return result;
 }
 
-int64 MCAS::MCASRead (int64 *a){
+void MCAS::destroyDesc(const int tid, void *p){
+    MCASDesc *d = (MCASDesc *)p;
+    freeBytes(tid, d, descBytes(d->N));
+}
+
+int64 MCAS::MCASRead (const int tid, int64 *a){
     int64 v;
-    for(v = Ccas->CCASRead(a); IsMCASDesc(v); v = Ccas->CCASRead(a))
-        MCASHelp((MCASDesc *)v);
+    for(v = Ccas->CCASRead(tid, a); IsMCASDesc(v); v = Ccas->CCASRead(tid, a)){
+        STAT_INC(tid, DESCRIPTOR_READS);
+        reclaimer->protect(tid, HP_MCAS_SLOT, (void *)(v & (~1)));
+        if(*a == v){
+            STAT_INC(tid, MCAS_HELPS);
+            MCASHelp(tid, (MCASDesc *)v);
+        }
+    }
     return v;
 }
 
-bool MCAS::MCASHelp(MCASDesc *d){
+//A CCAS descriptor stands for the expected value it replaced. An MCAS descriptor stands for its
+//new value if the MCAS has succeeded and for its expected value otherwise; the status is read
+//after the descriptor was seen in the word, and it leaves the word only after the decision, so
+//the read linearizes at that load or, if the MCAS succeeded since, at its decision.
+int64 MCAS::MCASReadNoHelp(const int tid, int64 *a){
+    while(true){
+        int64 v = *(volatile int64 *)a;
+        if(!Ccas->IsCCASDesc(v) && !IsMCASDesc(v)) return v;
+        STAT_INC(tid, DESCRIPTOR_READS);
+        if(Ccas->IsCCASDesc(v)){
+            reclaimer->protect(tid, HP_CCAS_SLOT, (void *)(v & (~2)));
+            if(*(volatile int64 *)a != v) continue;
+            return Ccas->CCASExpected(v);
+        }
+        MCASDesc *d = (MCASDesc *)(v & (~1));
+        reclaimer->protect(tid, HP_MCAS_SLOT, (void *)d);
+        if(*(volatile int64 *)a != v) continue;
+        STATUS status = *(volatile STATUS *)&d->status;
+        for(int i = 0; i < d->N; i++){
+            if(d->entries[i].a == a) return (status == SUCCEEDED) ? d->entries[i].n : d->entries[i].e;
+        }
+    }
+}
+
+bool MCAS::MCASHelp(const int tid, MCASDesc *d){
     int64 v;
     MCASDesc *dd = (MCASDesc *) ((int64)d & (~1));
     int64 desc = (int64)d | 1;
     STATUS desired = FAILED;
     for(int i = 0; i < dd->N; i++){
         while(true){
-            Ccas->doCCAS(dd->a[i], dd->e[i], desc, &dd->status);
-            v = *(dd->a[i]);
-            if(v == dd->e[i] && dd->status == UNDECIDED ) 
+            Ccas->doCCAS(tid, dd->entries[i].a, dd->entries[i].e, desc, &dd->status);
+            v = *(dd->entries[i].a);
+            if(v == dd->entries[i].e && dd->status == UNDECIDED ) 
                 continue;
             if( v == desc) break;
             if(!(IsMCASDesc(v))) goto decision_point;
-            MCASHelp( (MCASDesc *) v);
+            reclaimer->protect(tid, HP_MCAS_SLOT, (void *)(v & (~1)));
+            if(*(dd->entries[i].a) == v){
+                STAT_INC(tid, MCAS_HELPS);
+                MCASHelp(tid, (MCASDesc *) v);
+            }
         }
     }
     desired = SUCCEEDED;
@@ -106,7 +171,7 @@ decision_point:
     for(int i = 0; i < dd->N; i++){
         //int64 temp = (int64)d |1;
         //d->a[i]->compare_exchange_strong((int64*)temp, success? d->n[i] : d->e[i]);
-        vv = __sync_bool_compare_and_swap(dd->a[i], desc, success? dd->n[i] : dd->e[i]);
+        vv = __sync_bool_compare_and_swap(dd->entries[i].a, desc, success? dd->entries[i].n : dd->entries[i].e);
     }
     return success;
 }
@@ -123,7 +188,11 @@ void MCAS::valueWriteInt(int64 *a, int64 b){
     *a = b;
 }
 
-int64 MCAS::valueRead(int64 *a){
-    int64 v = MCASRead(a);
+int64 MCAS::valueRead(const int tid, int64 *a){
+    int64 v = MCASRead(tid, a);
     return v>>2;
+}
+
+int64 MCAS::valueReadNoHelp(const int tid, int64 *a){
+    return MCASReadNoHelp(tid, a)>>2;
 }
\ No newline at end of file
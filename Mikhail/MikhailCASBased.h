@@ -1,58 +1,160 @@
 #pragma once
 #include <tuple>
-#include <chrono>
-#include <random>
+#include <thread>
+#include <vector>
 
 #define IN 0
 #define DELETED 1
 #define DUPLICATE_KEY 2
 #define NO_SUCH_NODE 3
-#define maxLevel NR_LEVELS+1
+#define maxLevel (NR_LEVELS+1)
+#ifndef DELETEMIN_BATCH
+#define DELETEMIN_BATCH 32      //deleted towers deleteMin may pass before it unlinks them all at once
+#endif
+#ifndef RANGE_QUERY_RETRIES
+#define RANGE_QUERY_RETRIES 64  //optimistic scan attempts before rangeQuery blocks updates on its range
+#endif
 
-#include "defines.h"
+#include <atomic>
+
+#include "../defines.h"
+#include "../util.h"
+#include "../TaggedPtr.h"
+#include "../Reclaimer.h"
+#include "../ScanVersions.h"
+#include "../KeyTraits.h"
+#include "../Stats.h"
+#ifdef USE_ELIMINATION
+#include "../Elimination.h"
+#endif
+#ifdef USE_HASH_INDEX
+#include "../HashIndex.h"
+#endif
 
 using namespace std;
 
+/*
+ * Fomitchev-Ruppert lock-free skip list. Every level is a linked list of separate nodes whose
+ * succ is a TaggedPtr: FLAG announces that the successor is being deleted, MARK that the node
+ * itself is. Keys must lie strictly between KeyTraits<Key, Compare>::minKey() and maxKey();
+ * values are stored at the tower root as a ValueCodec word.
+ * Helpers follow back links from nodes that may already be unlinked, which hazard pointers
+ * cannot cover, so this list relies on the default epoch-based reclaimer.
+ * deleteMin borrows the deleted prefix of Linden and Jonsson: it marks the first live tower root
+ * on the bottom level without flagging its predecessor, so deleted towers pile up in front of the
+ * head and are unlinked DELETEMIN_BATCH or more at a time. Unlike their queue the mark is on the
+ * deleted node rather than on its predecessor's link, so inserts can still link a smaller key in
+ * front of the prefix and deleteMin is weaker than linearizable (see deleteMin). Every marked
+ * node has its back link set before its mark, so searches that meet one help it out as usual.
+ * Since a mark no longer implies a flag, erase and deleteMin both claim the root through CLAIMED
+ * in refs and only the claimer reports the key as deleted.
+ * With -DUSE_HASH_INDEX every tower root is also published in a HashIndex once it is linked on
+ * the bottom level, and removed from it by the releaseTower that retires it. contains takes an
+ * indexed root whose MARK is clear as proof that the key is present, since the root's mark is
+ * what deletes a key; keys the index does not hold a live root for are searched in the list.
+ * The index is sized for expectedKeys at construction (and grown again by bulkLoad); roots that
+ * find no free slot are counted as INDEX_OVERFLOWS.
+ */
+template <class Key = int, class Value = int, class Compare = less<Key>>
 class MikhailCASBased {
 private:
+    typedef KeyTraits<Key, Compare> KT;
+    typedef ValueCodec<Value> VC;
     volatile char padding0[PADDING_BYTES];
     const int numThreads;
     volatile char padding1[PADDING_BYTES];
     typedef struct Node{
-        int key, value;
-        Node *back_link, *succ;
-        Node *down, *up;           //Incase search never returns root, delete up pointer and separate head;
+        Key key;
+        atomic<int64> value;       //ValueCodec word, only meaningful at the tower root
+        atomic<Node *> back_link;
+        AtomicTaggedPtr<Node> succ;
+        Node *down, *up;           //up is only set in the head tower
         Node *tower_root; 
+        atomic<int> refs;          //Only used at the tower root: levels still linked, plus one while the inserter runs, plus CLAIMED
     } node;
-    struct STATUS{
-        int value;
+    //Predecessors found at each level by the previous search, so that a batch of sorted keys
+    //can resume from them instead of descending from the top of the head tower every time
+    struct Finger{
+        node *preds[maxLevel+1];
+        int top;
     };
+    typedef TaggedPtr<Node> tptr;
+    static const int CLAIMED = 1<<30;      //set in refs by the operation that reports the tower deleted
     node *head;
+    node *headTower[maxLevel+1];    //head node of every level, indexed from 1
+    Reclaimer *reclaimer;
+    atomic<int> topHint;            //level FindStart_SL looks at first, the last height cap computed
+    const double levelProbability;
     volatile char padding2[PADDING_BYTES];
+    ScanVersions scanVersions;
+    RandomLevel levelRngs[MAX_THREADS];
+    RandomNatural sprayRngs[MAX_THREADS];
+    int sprayHeight;                //level sprayDeleteMin starts from, log2(numThreads)+1
+    int sprayJump;                  //most nodes it moves right on each level, log2(numThreads)
+    counter sizeEstimate;           //inserts minus erases, only used to cap tower heights
+#ifdef USE_ELIMINATION
+    EliminationArray<Key, Value, Compare> elimination;
+    bool eliminationApply(const int tid, const int op, const Key & key, const Value & value);
+#endif
+#ifdef USE_HASH_INDEX
+    HashIndex<Key, Node, Compare> hashIndex;
+#endif
+
+    static bool before(const Key & a, const Key & key, const bool strict) { return strict ? KT::less(a, key) : KT::lessEq(a, key); }
+    static void destroyNode(const int tid, void *p);
+    static bool claimTower(node *root) { return !(root->refs.fetch_or(CLAIMED, memory_order_acq_rel) & CLAIMED); }
+    static bool isClaimed(node *root) { return root->refs.load(memory_order_acquire) & CLAIMED; }
+    void unlinkDeletedPrefix(const int tid);
+    void updateValue(const int tid, node *root, const Key & key, const Value & value);
+    int collectRange(const int tid, const Key & lo, const Key & hi, pair<Key, Value> *out);
 
 public:
-    MikhailCASBased(const int _numThreads);
+    typedef Key KeyType;
+    typedef Value ValueType;
+
+    //expectedKeys only sizes the hash index built with -DUSE_HASH_INDEX
+    MikhailCASBased(const int _numThreads, const double _levelProbability = 0.5, const long long expectedKeys = 0);
     ~MikhailCASBased();
     
     //Dictionary operations
-    int contains(const int & key);
-    bool insertOrUpdate(const int & key, const int & value); 
-    bool erase(const int & key); 
+    Value contains(const int tid, const Key & key);
+    bool insertOrUpdate(const int tid, const Key & key, const Value & value); 
+    bool erase(const int tid, const Key & key); 
+    
+    //Ordered operations
+    int rangeQuery(const int tid, const Key & lo, const Key & hi, pair<Key, Value> *out);
+    bool successor(const int tid, const Key & key, Key & succKey, Value & succValue);
+
+    //Priority queue operations; false when the list is empty
+    bool deleteMin(const int tid, Key & minKey, Value & minValue);
+    bool peekMin(const int tid, Key & minKey, Value & minValue);
+    //Relaxed deleteMin: removes one of roughly the first numThreads*log(numThreads) keys
+    bool sprayDeleteMin(const int tid, Key & minKey, Value & minValue);
+    
+    //Batched operations, cheapest when keys are sorted in increasing order
+    int insertBatch(const int tid, const pair<Key, Value> *kvs, const int n);
+    int eraseBatch(const int tid, const Key *keys, const int n);
+
+    //Initial population of an empty list, before any concurrent operation
+    void bulkLoad(const Key *keys, const Value *values, const long long n);
     
     //Assisting methods
-    void setNodeValues(node *, int, int, node *, node *);
-    tuple<MikhailCASBased::node *, MikhailCASBased::node *> SearchToLevel_SL (int, int);
-    tuple<MikhailCASBased::node *, int> FindStart_SL(int);
-    tuple<MikhailCASBased::node *, MikhailCASBased::node *> SearchToLevel_SL(int, node*);
-    tuple<MikhailCASBased::node *, MikhailCASBased::node *> SearchRight(int, node *);
-    tuple<MikhailCASBased::node *, MikhailCASBased::node *> SearchRight2(int, node *);
-    tuple<MikhailCASBased::node *, int, bool> TryFlagNode(node *, node *);
-    tuple<MikhailCASBased::node *, MikhailCASBased::node *> InsertNode(node *, node *, node *);
-    int determineLevel(int, double);
-    MikhailCASBased::node * DeleteNode(node *, node *);
-    void MikhailCASBased::HelpFlagged(node *, node *);
-    void MikhailCASBased::TryMark(node *del_node);
-    void MikhailCASBased::HelpMarked(node *prev_node, node *del_node);
+    void setNodeValues(node *, const Key &, int64, node *, node *);
+    bool Insert_SL(const int, const Key &, const Value &, Finger *);
+    bool Delete_SL(const int, const Key &, Finger *);
+    tuple<node *, node *> SearchToLevel_SL (const int, const Key &, int, Finger * = NULL, const bool = false);
+    tuple<node *, int> FindStart_SL(const int, int);
+    tuple<node *, node *> SearchRight(const int, const Key &, node *);
+    tuple<node *, node *> SearchRight2(const int, const Key &, node *);    //stops before key instead of at it
+    node *SearchNoHelp(const int, const Key &);
+    tuple<node *, int, bool> TryFlagNode(const int, node *, node *);
+    tuple<node *, node *> InsertNode(const int, node *, node *, node *);
+    int determineLevel(const int);
+    node * DeleteNode(const int, node *, node *);
+    void HelpFlagged(const int, node *, node *);
+    void TryMark(const int, node *del_node);
+    void HelpMarked(const int, node *prev_node, node *del_node);
+    void releaseTower(const int, node *root);
 
     int valueTraversal();
     void listTraversal();
@@ -60,192 +162,464 @@ public:
     void printDebuggingDetails();
 };
 
-MikhailCASBased::MikhailCASBased(const int _numThreads)
-        : numThreads(_numThreads) {
-    
+template <class Key, class Value, class Compare>
+MikhailCASBased<Key, Value, Compare>::MikhailCASBased(const int _numThreads, const double _levelProbability, const long long expectedKeys)
+        : numThreads(_numThreads), levelProbability(_levelProbability) {
+    reclaimer = new Reclaimer(_numThreads);
+#ifdef USE_HASH_INDEX
+    hashIndex.reserve(2*expectedKeys);
+#endif
+    topHint.store(1, MOR);
+    for(int tid = 0; tid < MAX_THREADS; tid++) levelRngs[tid].init((tid+1) * 0x9E3779B97F4A7C15ULL, levelProbability, 1);
+    for(int tid = 0; tid < MAX_THREADS; tid++) sprayRngs[tid].setSeed((tid+1) * 2654435761u);
+    sprayJump = 31 - __builtin_clz(max(1, numThreads));
+    sprayHeight = min(sprayJump + 1, maxLevel-1);
+    //Head and tail towers span every level. Towers are at most maxLevel-1 high, so the top
+    //level stays empty and FindStart_SL always stops below it.
+    node *headBelow = NULL, *tailBelow = NULL;
+    for(int v = 1; v <= maxLevel; v++){
+        node *h = allocObject<node>(0);
+        node *t = allocObject<node>(0);
+        setNodeValues(h, KT::minKey(), 0, headBelow, headBelow == NULL ? h : headBelow->tower_root);
+        setNodeValues(t, KT::maxKey(), 0, tailBelow, tailBelow == NULL ? t : tailBelow->tower_root);
+        h->succ.store(tptr(t, false, false), MOR);
+        if(headBelow == NULL) head = h;
+        else headBelow->up = h;
+        headTower[v] = h;
+        headBelow = h;
+        tailBelow = t;
+    }
 }
 
-MikhailCASBased::~MikhailCASBased() {
-    /*
-    node *n =head, *cur;
-    while(n!=NULL){
-        cur = n;
-        n = n->next[0];
-        delete cur;
+template <class Key, class Value, class Compare>
+MikhailCASBased<Key, Value, Compare>::~MikhailCASBased() {
+    delete reclaimer;
+    //deleteMin leaves the upper levels of a tower to later searches, so a root may already be
+    //unlinked while its tower is not. Such a root is counted only by the levels still linked.
+    for(int v = 2; v < maxLevel; v++){
+        for(node *n = headTower[v]->succ.ptr(); !KT::equal(n->key, KT::maxKey()); n = n->succ.ptr()){
+            node *root = n->tower_root;
+            if((root->refs.fetch_sub(1) & ~CLAIMED) == 1) destroyNode(0, root);
+        }
+    }
+    //What is still linked was never retired; free it level by level
+    node *level = head;
+    while(level != NULL){
+        node *up = level->up;
+        node *n = level;
+        while(n != NULL){
+            node *next = n->succ.ptr();
+            destroyNode(0, n);
+            n = next;
+        }
+        level = up;
     }
-    */
 }
 
-void MikhailCASBased::setNodeValues(node *n, int _key, int _value, node *down, node *troot){
+template <class Key, class Value, class Compare>
+void MikhailCASBased<Key, Value, Compare>::setNodeValues(node *n, const Key & _key, int64 _value, node *down, node *troot){
     n->key = _key;
-    n->value = _value;
-    n->back_link = NULL;
-    n->succ = NULL;
+    n->value.store(_value, MOR);
+    n->back_link.store(NULL, MOR);
+    n->succ.store(tptr(), MOR);
     n->up = NULL;
     n->down = down;
     n->tower_root = troot;
+    n->refs.store(1, MOR);
 }
 
-tuple<MikhailCASBased::node *, MikhailCASBased::node *> MikhailCASBased::SearchToLevel_SL(int key, int level){
+template <class Key, class Value, class Compare>
+tuple<typename MikhailCASBased<Key, Value, Compare>::node *, typename MikhailCASBased<Key, Value, Compare>::node *> MikhailCASBased<Key, Value, Compare>::SearchToLevel_SL(const int tid, const Key & key, int level, Finger *finger, const bool strict){
     node *curr_node, *next_node;
-    int curr_v;
-    tie(curr_node, curr_v) = FindStart_SL(level);
+    int curr_v = 0;
+    if(finger != NULL && finger->top >= level){
+        //Climb until a live finger whose successor lies beyond key, then descend from it
+        for(curr_v = level; curr_v <= finger->top; curr_v++){
+            node *f = finger->preds[curr_v];
+            if(!before(f->key, key, strict) || f->tower_root->succ.isMarked()) continue;
+            if(curr_v == finger->top || !before(f->succ.ptr()->key, key, strict)) break;
+        }
+        if(curr_v > finger->top) curr_v = 0;
+        else curr_node = finger->preds[curr_v];
+    }
+    if(curr_v == 0){
+        tie(curr_node, curr_v) = FindStart_SL(tid, level);
+        if(finger != NULL) finger->top = curr_v;
+    }
+    STAT_ADD(tid, LEVELS_TRAVERSED, curr_v - level + 1);
     while(curr_v>level){
-        tie(curr_node, next_node) = SearchRight(key, curr_node);
+        tie(curr_node, next_node) = strict ? SearchRight2(tid, key, curr_node) : SearchRight(tid, key, curr_node);
+        if(finger != NULL) finger->preds[curr_v] = curr_node;
         curr_node = curr_node->down;
         curr_v--;
     }
-    tie(curr_node, next_node) = SearchRight(key, curr_node);
+    tie(curr_node, next_node) = strict ? SearchRight2(tid, key, curr_node) : SearchRight(tid, key, curr_node);
+    if(finger != NULL) finger->preds[level] = curr_node;
     return make_tuple(curr_node, next_node);
 }
 
-tuple<MikhailCASBased::node *, int> MikhailCASBased::FindStart_SL(int level){
-    node *curr_node = head;
-    int curr_v = 1;
-    node *temp = (node *)((int)curr_node->up->succ & (~3));
-    while((temp->key != MAXKEY) || (curr_v < level)){          //No need to unmark. Head tower never gets marked
+template <class Key, class Value, class Compare>
+tuple<typename MikhailCASBased<Key, Value, Compare>::node *, int> MikhailCASBased<Key, Value, Compare>::FindStart_SL(const int tid, int level){
+    //Start at the hinted level rather than at the bottom of the head tower, climb while the level
+    //above is in use, then drop through levels that have emptied. The result is the lowest level
+    //at or above level with nothing above it, as if climbing from the bottom.
+    int curr_v = max(level, topHint.load(MOR));
+    node *curr_node = headTower[curr_v];
+    while(!KT::equal(curr_node->up->succ.ptr()->key, KT::maxKey())){          //No need to unmark. Head tower never gets marked
         curr_node = curr_node->up;
         curr_v++;
-        temp = (node *)((int)curr_node->up->succ & (~3));
+    }
+    while(curr_v > level && KT::equal(curr_node->succ.ptr()->key, KT::maxKey())){
+        curr_node = curr_node->down;
+        curr_v--;
     }
     return make_tuple(curr_node, curr_v);
 }
 
-tuple<MikhailCASBased::node *, MikhailCASBased::node *> MikhailCASBased::SearchRight(int key, node *curr_node){
-    node *next_node = (node *)((int)curr_node->succ & (~3));
-    while(next_node->key <= key){
-        while((int)next_node->tower_root->succ & 1){
+template <class Key, class Value, class Compare>
+tuple<typename MikhailCASBased<Key, Value, Compare>::node *, typename MikhailCASBased<Key, Value, Compare>::node *> MikhailCASBased<Key, Value, Compare>::SearchRight(const int tid, const Key & key, node *curr_node){
+    node *next_node = curr_node->succ.ptr();
+    while(KT::lessEq(next_node->key, key)){
+        while(next_node->tower_root->succ.isMarked()){
             int status;
             bool result;
-            tie(curr_node, status, result) = TryFlagNode(curr_node, next_node);
+            tie(curr_node, status, result) = TryFlagNode(tid, curr_node, next_node);
             if(status == IN){
-                HelpFlagged(curr_node, next_node);
+                HelpFlagged(tid, curr_node, next_node);
             }
-            next_node = (node *)((int)curr_node->succ & (~3));
+            next_node = curr_node->succ.ptr();
         }
-        if(next_node->key <= key){
+        if(KT::lessEq(next_node->key, key)){
+            STAT_INC(tid, NODES_TRAVERSED);
             curr_node = next_node;
-            next_node = (node *)((int)curr_node->succ & (~3));;
+            next_node = curr_node->succ.ptr();
         }
     }
     return make_tuple(curr_node, next_node);
 }
 
-tuple<MikhailCASBased::node *, MikhailCASBased::node *> MikhailCASBased::SearchRight2(int key, node *curr_node){
-    node *next_node = (node *)((int)curr_node->succ & (~3));;
-    while(next_node->key < key){
-        while((int)next_node->tower_root->succ & 1){
-            STATUS *status;
+template <class Key, class Value, class Compare>
+tuple<typename MikhailCASBased<Key, Value, Compare>::node *, typename MikhailCASBased<Key, Value, Compare>::node *> MikhailCASBased<Key, Value, Compare>::SearchRight2(const int tid, const Key & key, node *curr_node){
+    node *next_node = curr_node->succ.ptr();
+    while(KT::less(next_node->key, key)){
+        while(next_node->tower_root->succ.isMarked()){
+            int status;
             bool result;
-            tie(curr_node, status, result) = TryFlagNode(curr_node, next_node);
-            if(status->value == IN){
-                HelpFlagged(curr_node, next_node);
+            tie(curr_node, status, result) = TryFlagNode(tid, curr_node, next_node);
+            if(status == IN){
+                HelpFlagged(tid, curr_node, next_node);
             }
-            next_node = (node *)((int)curr_node->succ & (~3));
+            next_node = curr_node->succ.ptr();
         }
-        if(next_node->key <= key){
+        if(KT::less(next_node->key, key)){
+            STAT_INC(tid, NODES_TRAVERSED);
             curr_node = next_node;
-            next_node = (node *)((int)curr_node->succ & (~3));
+            next_node = curr_node->succ.ptr();
         }
     }
     return make_tuple(curr_node, next_node);
 }
 
-int MikhailCASBased::contains(const int & key) {
-    node *curr_node, next_node;
-    tie(curr_node, next_node) = SearchToLevel_SL(key, 1);
-    if(curr_node->key == key){
-        return curr_node->tower_root->value;
+template <class Key, class Value, class Compare>
+Value MikhailCASBased<Key, Value, Compare>::contains(const int tid, const Key & key) {
+    Guard guard(reclaimer, tid);
+    node *root = NULL;
+#ifdef USE_HASH_INDEX
+    root = hashIndex.find(key, [](node *n){ return !n->succ.isMarked(); });
+    if(root != NULL) STAT_INC(tid, INDEX_HITS);
+    else root = SearchNoHelp(tid, key);
+#else
+    root = SearchNoHelp(tid, key);
+#endif
+    if(root != NULL){
+        return VC::decode(root->value.load(memory_order_acquire));
+    }
+    return VC::absent();
+}
+
+/*
+ * Read-only search for contains, as in the wait-free contains of Herlihy and Shavit's lock-free
+ * skip list: nodes whose tower root is marked are stepped over instead of being flagged and
+ * unlinked, and the search only stands on, or descends from, nodes whose root it saw unmarked.
+ * Such a node was still linked on every level it reached when it was checked, because a root is
+ * marked before any node of its tower is unlinked, so every node the search reaches was in the
+ * list at some point during the search. Returns the root of key's tower if it was unmarked
+ * when found, NULL otherwise.
+ */
+template <class Key, class Value, class Compare>
+typename MikhailCASBased<Key, Value, Compare>::node * MikhailCASBased<Key, Value, Compare>::SearchNoHelp(const int tid, const Key & key){
+    node *curr_node;
+    int curr_v;
+    tie(curr_node, curr_v) = FindStart_SL(tid, 1);
+    STAT_ADD(tid, LEVELS_TRAVERSED, curr_v);
+    while(true){
+        node *next_node = curr_node->succ.ptr();
+        while(true){
+            if(next_node->tower_root->succ.isMarked()){
+                next_node = next_node->succ.ptr();
+                continue;
+            }
+            if(!KT::less(next_node->key, key)) break;
+            STAT_INC(tid, NODES_TRAVERSED);
+            curr_node = next_node;
+            next_node = curr_node->succ.ptr();
+        }
+        if(KT::equal(next_node->key, key)) return next_node->tower_root;
+        if(curr_v == 1) return NULL;
+        curr_node = curr_node->down;
+        curr_v--;
     }
-    return MINVAL;
 }
 
 
-bool MikhailCASBased::insertOrUpdate(const int & key, const int & value) {
+template <class Key, class Value, class Compare>
+bool MikhailCASBased<Key, Value, Compare>::insertOrUpdate(const int tid, const Key & key, const Value & value) {
+#ifdef USE_ELIMINATION
+    bool result;
+    if(elimination.exchange(tid, ELIM_INSERT, key, value, result,
+            [&](const int op, const Value & v){ return eliminationApply(tid, op, key, v); })) return result;
+#endif
+    Guard guard(reclaimer, tid);
+    return Insert_SL(tid, key, value, NULL);
+}
+
+template <class Key, class Value, class Compare>
+void MikhailCASBased<Key, Value, Compare>::updateValue(const int tid, node *root, const Key & key, const Value & value){
+    int64 val = root->value.load(memory_order_acquire), newVal = VC::encode(tid, value);
+    scanVersions.startUpdate(KT::scanKey(key));
+    STAT_INC(tid, CAS_ATTEMPTS);
+    while(!root->value.compare_exchange_weak(val, newVal, memory_order_acq_rel, memory_order_acquire)){
+        STAT_INC(tid, CAS_ATTEMPTS);
+        STAT_INC(tid, CAS_FAILURES);
+    }
+    scanVersions.finishUpdate(KT::scanKey(key));
+    VC::release(tid, reclaimer, val);
+}
+
+template <class Key, class Value, class Compare>
+bool MikhailCASBased<Key, Value, Compare>::Insert_SL(const int tid, const Key & key, const Value & value, Finger *finger) {
     node *prev_node, *next_node, *result;
-    tie(prev_node, next_node) = SearchToLevel_SL(key, 1);
+    tie(prev_node, next_node) = SearchToLevel_SL(tid, key, 1, finger);
 
-    if(prev_node->key == key){ //duplicate key, update the value at the tower root
-        int val;
-        do{
-            val = prev_node->tower_root->value;
-        }while(!__sync_bool_compare_and_swap(&prev_node->tower_root->value, val, value));
+    if(KT::equal(prev_node->key, key)){ //duplicate key, update the value at the tower root
+        updateValue(tid, prev_node->tower_root, key, value);
+        return false;
     }
     
-    node *rnode = new node();
-    setNodeValues(rnode, key, value, NULL, rnode);
+    node *rnode = allocObject<node>(tid);
+    setNodeValues(rnode, key, VC::encode(tid, value), NULL, rnode);
     node *new_node = rnode;
-    int tH = determineLevel(key, 0.5);
+    int tH = determineLevel(tid);
     int curr_v = 1;
     while(true){
-        tie(prev_node, result) = InsertNode(new_node, prev_node, next_node);
-        if((int) result == DUPLICATE_KEY && curr_v == 1){
-            delete new_node;
-            return false;
+        //Count the level before linking it, so that an unlink racing with this insert
+        //cannot drop the count to zero while the tower is still being built
+        rnode->refs.fetch_add(1);
+        if(curr_v == 1) scanVersions.startUpdate(KT::scanKey(key));
+        tie(prev_node, result) = InsertNode(tid, new_node, prev_node, next_node);
+        if(curr_v == 1) scanVersions.finishUpdate(KT::scanKey(key));
+        if(result == (node *)DUPLICATE_KEY){
+            rnode->refs.fetch_sub(1);
+            destroyNode(tid, new_node);
+            if(curr_v == 1){
+                updateValue(tid, prev_node->tower_root, key, value);
+                return false;
+            }
+            releaseTower(tid, rnode);
+            return true;
         }
-        if((int)rnode->succ & 2){
-            if((int)result == (int) new_node && (int)new_node != (int)rnode){
-                DeleteNode(prev_node, new_node);
+        if(curr_v == 1){
+            sizeEstimate.inc(tid);
+#ifdef USE_HASH_INDEX
+            //the inserter's reference keeps rnode from being retired first
+            if(!hashIndex.publish(rnode)) STAT_INC(tid, INDEX_OVERFLOWS);
+#endif
+        }
+        if(rnode->succ.isMarked()){
+            if(result == new_node && new_node != rnode){
+                DeleteNode(tid, prev_node, new_node);
             }
+            releaseTower(tid, rnode);
             return true;
         }
         curr_v++;
-        if(curr_v == tH) return true;
+        if(curr_v > tH){
+            releaseTower(tid, rnode);
+            return true;
+        }
         node *last_node = new_node;
-        new_node = new node();
-        setNodeValues(new_node, key, MINVAL, last_node, rnode);
-        tie(prev_node, next_node) = SearchToLevel_SL(key, curr_v);
+        new_node = allocObject<node>(tid);
+        setNodeValues(new_node, key, 0, last_node, rnode);
+        tie(prev_node, next_node) = SearchToLevel_SL(tid, key, curr_v, finger);
     }
     return true;
 }
 
-tuple<MikhailCASBased::node *, MikhailCASBased::node *> MikhailCASBased::InsertNode(node *newNode, node *prev_node, node *next_node){
-    if(prev_node->key == newNode->key){
+template <class Key, class Value, class Compare>
+tuple<typename MikhailCASBased<Key, Value, Compare>::node *, typename MikhailCASBased<Key, Value, Compare>::node *> MikhailCASBased<Key, Value, Compare>::InsertNode(const int tid, node *newNode, node *prev_node, node *next_node){
+    if(KT::equal(prev_node->key, newNode->key)){
         return make_tuple(prev_node, (node *)DUPLICATE_KEY);
     }
     while(true){
-        node * prev_succ = prev_node->succ;
-        if((int)prev_succ & 1){
-            HelpFlagged(prev_node, (node *)((int)prev_succ & (~1)));
+        tptr prev_succ = prev_node->succ.load();
+        if(prev_succ.isFlagged()){
+            HelpFlagged(tid, prev_node, prev_succ.ptr());
         }
         else{
-            newNode->succ = next_node;
-            node * result = __sync_val_compare_and_swap(&prev_node->succ, next_node, newNode);
-            if(result == (node *)((int)next_node & (~3))){
+            newNode->succ.store(tptr(next_node, false, false), MOR);
+            tptr expected(next_node, false, false);
+            STAT_INC(tid, CAS_ATTEMPTS);
+            if(prev_node->succ.compareExchange(expected, tptr(newNode, false, false))){
                 return make_tuple(prev_node, newNode);
             }
             else{
-                if((int)result & 1){
-                    HelpFlagged(prev_node, (node *)((int)result->succ & (~1)));
+                STAT_INC(tid, CAS_FAILURES);
+                if(expected.isFlagged()){
+                    HelpFlagged(tid, prev_node, expected.ptr());
                 }
-                while((int)prev_node->succ & 2){
-                    prev_node = prev_node->back_link;
+                while(prev_node->succ.isMarked()){
+                    STAT_INC(tid, BACKLINK_WALKS);
+                    prev_node = prev_node->back_link.load(memory_order_acquire);
                 }
             }
         }
-        tie(prev_node, next_node) = SearchRight(newNode->key, prev_node);
-        if(prev_node->key == newNode->key){
+        STAT_INC(tid, SEARCH_RESTARTS);
+        tie(prev_node, next_node) = SearchRight(tid, newNode->key, prev_node);
+        if(KT::equal(prev_node->key, newNode->key)){
             return make_tuple(prev_node, (node *)DUPLICATE_KEY);
         }
     }
 }
 
-bool MikhailCASBased::erase(const int & key) {
+template <class Key, class Value, class Compare>
+bool MikhailCASBased<Key, Value, Compare>::erase(const int tid, const Key & key) {
+#ifdef USE_ELIMINATION
+    bool result;
+    if(elimination.exchange(tid, ELIM_ERASE, key, Value(), result,
+            [&](const int op, const Value & v){ return eliminationApply(tid, op, key, v); })) return result;
+#endif
+    Guard guard(reclaimer, tid);
+    return Delete_SL(tid, key, NULL);
+}
+
+#ifdef USE_ELIMINATION
+template <class Key, class Value, class Compare>
+bool MikhailCASBased<Key, Value, Compare>::eliminationApply(const int tid, const int op, const Key & key, const Value & value) {
+    Guard guard(reclaimer, tid);
+    if(op == ELIM_INSERT) return Insert_SL(tid, key, value, NULL);
+    if(op == ELIM_ERASE) return Delete_SL(tid, key, NULL);
+    node *curr_node, *next_node;
+    tie(curr_node, next_node) = SearchToLevel_SL(tid, key, 1);
+    return KT::equal(curr_node->key, key);
+}
+#endif
+
+template <class Key, class Value, class Compare>
+bool MikhailCASBased<Key, Value, Compare>::Delete_SL(const int tid, const Key & key, Finger *finger) {
     node *prev_node, *del_node;
-    tie(prev_node, del_node) = SearchToLevel_SL(key-1, 1);
-    if(del_node->key != key) return false;
-    node * result = DeleteNode(prev_node, del_node);
-    if((int)result == NO_SUCH_NODE) return false;
-    SearchToLevel_SL(key, 2);
-    return true;
+    tie(prev_node, del_node) = SearchToLevel_SL(tid, key, 1, finger, true);
+    if(!KT::equal(del_node->key, key)) return false;
+    scanVersions.startUpdate(KT::scanKey(key));
+    node * result = DeleteNode(tid, prev_node, del_node);
+    scanVersions.finishUpdate(KT::scanKey(key));
+    if(result == (node *)NO_SUCH_NODE) return false;
+    bool claimed = claimTower(del_node);        //false if deleteMin took the tower first
+    if(claimed) sizeEstimate.add(tid, -1);
+    SearchToLevel_SL(tid, key, 2, finger);      //unlinks the rest of the tower
+    return claimed;
+}
+
+//Each key resumes from the predecessors of the previous one; returns the number of keys newly inserted
+template <class Key, class Value, class Compare>
+int MikhailCASBased<Key, Value, Compare>::insertBatch(const int tid, const pair<Key, Value> *kvs, const int n){
+    Guard guard(reclaimer, tid);
+    Finger finger;
+    finger.top = 0;
+    int inserted = 0;
+    for(int i = 0; i < n; i++){
+        inserted += Insert_SL(tid, kvs[i].first, kvs[i].second, &finger);
+    }
+    return inserted;
+}
+
+//Returns the number of keys erased
+template <class Key, class Value, class Compare>
+int MikhailCASBased<Key, Value, Compare>::eraseBatch(const int tid, const Key *keys, const int n){
+    Guard guard(reclaimer, tid);
+    Finger finger;
+    finger.top = 0;
+    int erased = 0;
+    for(int i = 0; i < n; i++){
+        erased += Delete_SL(tid, keys[i], &finger);
+    }
+    return erased;
+}
+
+//Keys must be strictly increasing. Each of numThreads threads builds the towers of one slice of
+//the keys in key order, so a slice is allocated contiguously, and links them on every level; the
+//slices are then stitched together level by level between the head and tail towers.
+template <class Key, class Value, class Compare>
+void MikhailCASBased<Key, Value, Compare>::bulkLoad(const Key *keys, const Value *values, const long long n){
+    const int cap = RandomLevel::heightForSize(n, levelProbability, maxLevel-1);
+    const int T = (int)max(1LL, min((long long)numThreads, n));
+    vector<node *> first(T*maxLevel, NULL), last(T*maxLevel, NULL);        //levels 1..maxLevel-1
+    thread *threads[MAX_THREADS];
+#ifdef USE_HASH_INDEX
+    hashIndex.reserve(2*n);
+#endif
+    for(int tid = 0; tid < T; tid++){
+        threads[tid] = new thread([&, tid](){
+            node **f = &first[tid*maxLevel], **l = &last[tid*maxLevel];
+            levelRngs[tid].setMaxHeight(cap);
+            for(long long i = n*tid/T; i < n*(tid+1)/T; i++){
+                int h = levelRngs[tid].next();
+                node *root = allocObject<node>(tid);
+                setNodeValues(root, keys[i], VC::encode(tid, values[i]), NULL, root);
+                root->refs.store(h, MOR);
+#ifdef USE_HASH_INDEX
+                if(!hashIndex.publish(root)) STAT_INC(tid, INDEX_OVERFLOWS);
+#endif
+                node *below = NULL;
+                for(int v = 1; v <= h; v++){
+                    node *x = root;
+                    if(v > 1){
+                        x = allocObject<node>(tid);
+                        setNodeValues(x, keys[i], 0, below, root);
+                    }
+                    if(l[v] == NULL) f[v] = x;
+                    else l[v]->succ.store(tptr(x, false, false), MOR);
+                    l[v] = x;
+                    below = x;
+                }
+            }
+        });
+    }
+    for(int tid = 0; tid < T; tid++){
+        threads[tid]->join();
+        delete threads[tid];
+    }
+    for(int v = 1; v < maxLevel; v++){
+        node *prev = headTower[v];
+        node *tail = prev->succ.ptr();
+        for(int tid = 0; tid < T; tid++){
+            if(first[tid*maxLevel+v] == NULL) continue;
+            prev->succ.store(tptr(first[tid*maxLevel+v], false, false), MOR);
+            prev = last[tid*maxLevel+v];
+        }
+        prev->succ.store(tptr(tail, false, false), MOR);
+    }
+    sizeEstimate.add(0, n);
+    topHint.store(cap, MOR);
+    atomic_thread_fence(memory_order_seq_cst);
 }
 
-MikhailCASBased::node * MikhailCASBased::DeleteNode(node *prev_node, node *del_node){
+template <class Key, class Value, class Compare>
+typename MikhailCASBased<Key, Value, Compare>::node * MikhailCASBased<Key, Value, Compare>::DeleteNode(const int tid, node *prev_node, node *del_node){
     int status;
     bool result;
-    tie(prev_node, status, result) = TryFlagNode(prev_node, del_node);
+    tie(prev_node, status, result) = TryFlagNode(tid, prev_node, del_node);
     if(status == IN){
-        HelpFlagged(prev_node, del_node);
+        HelpFlagged(tid, prev_node, del_node);
     }
     if(result == false){
         return (node *)NO_SUCH_NODE;
@@ -253,104 +627,323 @@ MikhailCASBased::node * MikhailCASBased::DeleteNode(node *prev_node, node *del_n
     return del_node;
 }
 
-tuple<MikhailCASBased::node *, int, bool> MikhailCASBased::TryFlagNode(node *prev_node, node *target_node){
+template <class Key, class Value, class Compare>
+tuple<typename MikhailCASBased<Key, Value, Compare>::node *, int, bool> MikhailCASBased<Key, Value, Compare>::TryFlagNode(const int tid, node *prev_node, node *target_node){
+    const tptr flagged(target_node, false, true);
     while(true){
-        if((int)prev_node->succ == ((int)target_node | 1)){
+        if(prev_node->succ.load() == flagged){
             return make_tuple(prev_node, IN, false);
         }
-        int targetnode = (int)target_node & (~3);
-        int result = (int)__sync_val_compare_and_swap(&prev_node->succ, targetnode, targetnode | 1);
-        if(result == targetnode){
+        tptr expected(target_node, false, false);
+        STAT_INC(tid, CAS_ATTEMPTS);
+        if(prev_node->succ.compareExchange(expected, flagged)){
             return make_tuple(prev_node, IN, true);
         }
-        if(result == targetnode | 1){
+        STAT_INC(tid, CAS_FAILURES);
+        if(expected == flagged){
             return make_tuple(prev_node, IN, false);
         }
-        while((int)prev_node & 2){
-            prev_node = prev_node->back_link;
+        while(prev_node->succ.isMarked()){
+            STAT_INC(tid, BACKLINK_WALKS);
+            prev_node = prev_node->back_link.load(memory_order_acquire);
         }
         node *del_node;
-        tie(prev_node, del_node) = SearchRight2(target_node->key, prev_node);
-        if((int)del_node != (int)target_node){
+        STAT_INC(tid, SEARCH_RESTARTS);
+        tie(prev_node, del_node) = SearchRight2(tid, target_node->key, prev_node);
+        if(del_node != target_node){
             return make_tuple(prev_node, DELETED, false);
         }
     }
 }
 
-void MikhailCASBased::HelpFlagged(node *prev_node, node *del_node){
-    del_node->back_link = prev_node;
-    if((int)del_node->succ & 2 == 0){
-        TryMark(del_node);
+template <class Key, class Value, class Compare>
+void MikhailCASBased<Key, Value, Compare>::HelpFlagged(const int tid, node *prev_node, node *del_node){
+    del_node->back_link.store(prev_node, memory_order_release);
+    if(!del_node->succ.isMarked()){
+        TryMark(tid, del_node);
     }
-    HelpMarked(prev_node, del_node);
+    HelpMarked(tid, prev_node, del_node);
 }
 
-void MikhailCASBased::TryMark(node *del_node){
+template <class Key, class Value, class Compare>
+void MikhailCASBased<Key, Value, Compare>::TryMark(const int tid, node *del_node){
     do{
-        int next_node = (int)del_node->succ & (~3);
-        node * result = __sync_val_compare_and_swap(&del_node->succ, (node *)next_node, (node *)(next_node & 2));
-        if((int)result & 1){
-            HelpFlagged(del_node, (node *)((int)result & (~1)));
+        node *next_node = del_node->succ.ptr();
+        tptr expected(next_node, false, false);
+        STAT_INC(tid, CAS_ATTEMPTS);
+        if(!del_node->succ.compareExchange(expected, tptr(next_node, true, false))){
+            STAT_INC(tid, CAS_FAILURES);
+            if(expected.isFlagged()) HelpFlagged(tid, del_node, expected.ptr());
         }
-    }while((int)del_node->succ & 2 == 0);
+    }while(!del_node->succ.isMarked());
 }
 
-void MikhailCASBased::HelpMarked(node *prev_node, node *del_node){
-    node *next_node = (node *)((int)del_node->succ &(~3));
-    bool result = __sync_bool_compare_and_swap(&prev_node->succ, (node *)((int)del_node & 2), next_node);
+template <class Key, class Value, class Compare>
+void MikhailCASBased<Key, Value, Compare>::HelpMarked(const int tid, node *prev_node, node *del_node){
+    node *next_node = del_node->succ.ptr();
+    tptr expected(del_node, false, true);
+    bool result = prev_node->succ.compareExchange(expected, tptr(next_node, false, false));
+    STAT_INC(tid, CAS_ATTEMPTS);
+    if(!result) STAT_INC(tid, CAS_FAILURES);
+    //Exactly one thread unlinks each node. Upper levels still point at the root through
+    //tower_root, so the root is only retired once every level of its tower is gone.
+    if(result){
+        if(del_node != del_node->tower_root) reclaimer->retire(tid, del_node, destroyNode);
+        releaseTower(tid, del_node->tower_root);
+    }
 }
 
-long MikhailCASBased::getSumOfKeys() {
-    long sum = 0;
-    node *n = head;
-    while(n!=NULL){
-        if(n->key>MINKEY && n->key < MAXKEY){
-            sum += n->key;
+//Non-root nodes hold a zero value word, so only roots release a boxed value
+template <class Key, class Value, class Compare>
+void MikhailCASBased<Key, Value, Compare>::destroyNode(const int tid, void *p){
+    node *n = (node *)p;
+    VC::discard(tid, n->value.load(MOR));
+    freeObject(tid, n);
+}
+
+template <class Key, class Value, class Compare>
+void MikhailCASBased<Key, Value, Compare>::releaseTower(const int tid, node *root){
+    if((root->refs.fetch_sub(1, memory_order_acq_rel) & ~CLAIMED) == 1){
+#ifdef USE_HASH_INDEX
+        hashIndex.remove(root);
+#endif
+        reclaimer->retire(tid, root, destroyNode);
+    }
+}
+
+//Unmarked bottom-level nodes with keys in [lo, hi], in key order
+template <class Key, class Value, class Compare>
+int MikhailCASBased<Key, Value, Compare>::collectRange(const int tid, const Key & lo, const Key & hi, pair<Key, Value> *out){
+    node *curr_node, *next_node;
+    tie(curr_node, next_node) = SearchToLevel_SL(tid, lo, 1, NULL, true);
+    int count = 0;
+    while(KT::lessEq(next_node->key, hi)){
+        tptr succ = next_node->succ.load();
+        if(!succ.isMarked()){
+            out[count++] = make_pair(next_node->key, VC::decode(next_node->value.load(memory_order_acquire)));
+        }
+        next_node = succ.ptr();
+    }
+    return count;
+}
+
+/*
+ * Linearizable scan of the bottom level. Every update linearizes between the startUpdate and
+ * finishUpdate of its own key, so if ScanVersions saw no update begin on the range's stripes
+ * while the scan ran, the collected keys were all present together at the time it was validated.
+ * Scans are optimistic for RANGE_QUERY_RETRIES attempts; after that the query blocks updates on
+ * its stripes, waits for those in flight and scans once more, so it cannot starve, at the cost of
+ * updates to those stripes waiting for it (and it for an updater that is preempted).
+ * out must have room for hi-lo+1 entries; returns the number of keys written.
+ */
+template <class Key, class Value, class Compare>
+int MikhailCASBased<Key, Value, Compare>::rangeQuery(const int tid, const Key & lo, const Key & hi, pair<Key, Value> *out){
+    Guard guard(reclaimer, tid);
+    for(int attempt = 0; attempt < RANGE_QUERY_RETRIES; attempt++){
+        uint64_t token;
+        if(!scanVersions.beginScan(KT::scanKey(lo), KT::scanKey(hi), token)){
+            cpuRelax();
+            continue;
+        }
+        int count = collectRange(tid, lo, hi, out);
+        if(scanVersions.validateScan(KT::scanKey(lo), KT::scanKey(hi), token)) return count;
+    }
+    STAT_INC(tid, RANGE_BLOCKING_SCANS);
+    scanVersions.blockRange(KT::scanKey(lo), KT::scanKey(hi));
+    int count = collectRange(tid, lo, hi, out);
+    scanVersions.unblockRange(KT::scanKey(lo), KT::scanKey(hi));
+    return count;
+}
+
+//Smallest key greater than key, for forward iteration; false at the end of the list
+template <class Key, class Value, class Compare>
+bool MikhailCASBased<Key, Value, Compare>::successor(const int tid, const Key & key, Key & succKey, Value & succValue){
+    Guard guard(reclaimer, tid);
+    node *curr_node, *next_node;
+    tie(curr_node, next_node) = SearchToLevel_SL(tid, key, 1);
+    if(KT::equal(next_node->key, KT::maxKey())) return false;
+    succKey = next_node->key;
+    succValue = VC::decode(next_node->value.load(memory_order_acquire));
+    return true;
+}
+
+/*
+ * Removes the first live key. Towers that are marked or claimed in front of it are passed over
+ * without helping, so concurrent calls spread over the first live towers instead of all
+ * contending on the head's successor. The removed key is present until this call marks it, and
+ * every key that was present and unclaimed for the whole call is at least as large. A smaller
+ * key can still be present at the mark if it was inserted while the call ran (an insert may link
+ * in front of towers already passed over) or is being removed by a concurrent deleteMin, so the
+ * operation is not linearizable; it is exact whenever no smaller key is inserted concurrently.
+ */
+template <class Key, class Value, class Compare>
+bool MikhailCASBased<Key, Value, Compare>::deleteMin(const int tid, Key & minKey, Value & minValue){
+    Guard guard(reclaimer, tid);
+    int passed = 0;
+    node *curr_node = head->succ.ptr();
+    while(!KT::equal(curr_node->key, KT::maxKey())){
+        tptr succ = curr_node->succ.load();
+        if(succ.isMarked() || isClaimed(curr_node) || !claimTower(curr_node)){
+            STAT_INC(tid, NODES_TRAVERSED);
+            passed++;
+            curr_node = succ.ptr();
+            continue;
+        }
+        minKey = curr_node->key;
+        curr_node->back_link.store(head, memory_order_release);        //the head precedes every passed tower
+        scanVersions.startUpdate(KT::scanKey(minKey));
+        TryMark(tid, curr_node);
+        scanVersions.finishUpdate(KT::scanKey(minKey));
+        minValue = VC::decode(curr_node->value.load(memory_order_acquire));
+        sizeEstimate.add(tid, -1);
+        if(passed >= DELETEMIN_BATCH) unlinkDeletedPrefix(tid);
+        return true;
+    }
+    return false;
+}
+
+template <class Key, class Value, class Compare>
+bool MikhailCASBased<Key, Value, Compare>::peekMin(const int tid, Key & minKey, Value & minValue){
+    Guard guard(reclaimer, tid);
+    node *curr_node = head->succ.ptr();
+    while(!KT::equal(curr_node->key, KT::maxKey())){
+        tptr succ = curr_node->succ.load();
+        if(!succ.isMarked() && !isClaimed(curr_node)){
+            minKey = curr_node->key;
+            minValue = VC::decode(curr_node->value.load(memory_order_acquire));
+            return true;
         }
-        n = n->succ;
+        curr_node = succ.ptr();
+    }
+    return false;
+}
+
+/*
+ * SprayList (Alistarh et al.) relaxed deleteMin. A random walk starts at level sprayHeight of the
+ * head tower, moves right up to sprayJump nodes on each level and drops one level, so it lands
+ * on one of about 2^sprayHeight * sprayJump keys. Walks of different threads mostly land on
+ * different keys, and the first live tower after the landing point is deleted as erase deletes
+ * it, flag then mark. Passed-over towers are not helped. A walk that lands beyond the last key
+ * falls back to deleteMin.
+ */
+template <class Key, class Value, class Compare>
+bool MikhailCASBased<Key, Value, Compare>::sprayDeleteMin(const int tid, Key & minKey, Value & minValue){
+    {
+        Guard guard(reclaimer, tid);
+        RandomNatural & rng = sprayRngs[tid];
+        node *curr_node = headTower[sprayHeight];
+        for(int v = sprayHeight; ; v--){
+            for(int steps = rng.nextNatural() % (sprayJump+1); steps > 0; steps--){
+                node *next_node = curr_node->succ.ptr();
+                if(KT::equal(next_node->key, KT::maxKey())) break;
+                STAT_INC(tid, NODES_TRAVERSED);
+                curr_node = next_node;
+            }
+            if(v == 1) break;
+            curr_node = curr_node->down;
+        }
+        node *prev_node = curr_node, *del_node = curr_node->succ.ptr();
+        while(!KT::equal(del_node->key, KT::maxKey())){
+            if(!del_node->succ.isMarked() && !isClaimed(del_node)){
+                scanVersions.startUpdate(KT::scanKey(del_node->key));
+                node *result = DeleteNode(tid, prev_node, del_node);
+                scanVersions.finishUpdate(KT::scanKey(del_node->key));
+                if(result != (node *)NO_SUCH_NODE && claimTower(del_node)){
+                    minKey = del_node->key;
+                    minValue = VC::decode(del_node->value.load(memory_order_acquire));
+                    sizeEstimate.add(tid, -1);
+                    SearchToLevel_SL(tid, minKey, 2);      //unlinks the rest of the tower
+                    return true;
+                }
+            }
+            prev_node = del_node;
+            del_node = del_node->succ.ptr();
+        }
+    }
+    return deleteMin(tid, minKey, minValue);
+}
+
+//On every level, marks the nodes of deleted towers that directly follow the head and swings the
+//head past all of them with one CAS. Marked nodes can no longer change their succ, so the run is
+//fixed once marked and only a change of the head's succ (an insert or a helper) defeats the CAS.
+template <class Key, class Value, class Compare>
+void MikhailCASBased<Key, Value, Compare>::unlinkDeletedPrefix(const int tid){
+    for(int v = 1; v < maxLevel; v++){
+        node *h = headTower[v];
+        tptr first = h->succ.load();
+        if(KT::equal(first.ptr()->key, KT::maxKey())) break;
+        if(first.isFlagged()) continue;         //a search is already unlinking the first node
+        node *curr_node = first.ptr();
+        while(curr_node->tower_root->succ.isMarked()){
+            if(!curr_node->succ.isMarked()){
+                curr_node->back_link.store(h, memory_order_release);
+                TryMark(tid, curr_node);
+            }
+            curr_node = curr_node->succ.ptr();
+        }
+        if(curr_node == first.ptr()) continue;
+        tptr expected = first;
+        STAT_INC(tid, CAS_ATTEMPTS);
+        if(!h->succ.compareExchange(expected, tptr(curr_node, false, false))){
+            STAT_INC(tid, CAS_FAILURES);
+            continue;
+        }
+        for(node *n = first.ptr(); n != curr_node; ){
+            node *next = n->succ.ptr();
+            if(n != n->tower_root) reclaimer->retire(tid, n, destroyNode);
+            releaseTower(tid, n->tower_root);
+            n = next;
+        }
+    }
+}
+
+template <class Key, class Value, class Compare>
+long MikhailCASBased<Key, Value, Compare>::getSumOfKeys() {
+    long sum = 0;
+    node *n = head->succ.ptr();
+    while(!KT::equal(n->key, KT::maxKey())){
+        if(!n->succ.isMarked()) sum += KT::checksum(n->key);
+        n = n->succ.ptr();
     }
     return sum;
 }
 
-void MikhailCASBased::printDebuggingDetails() {
+template <class Key, class Value, class Compare>
+void MikhailCASBased<Key, Value, Compare>::printDebuggingDetails() {
     //listTraversal();
 }
 
-int MikhailCASBased::determineLevel(int key, double prob){
-    mt19937_64 rng;
-    uint64_t timeSeed = std::chrono::high_resolution_clock::now().time_since_epoch().count();
-    seed_seq ss{uint32_t(timeSeed & 0xffffffff), uint32_t(timeSeed>>32)};
-    rng.seed(ss);
-    uniform_real_distribution<double> distribution(0.0,1.0);
-    int tH = 1;
-    double number = distribution(rng);
-    while(tH<maxLevel-1){
-        if(number<(1-prob)) break;
-        number = distribution(rng);
-        tH++;
+//Geometric height from one draw of the thread's own generator, capped by the size estimate so
+//that small lists do not build towers that searches must then descend through
+template <class Key, class Value, class Compare>
+int MikhailCASBased<Key, Value, Compare>::determineLevel(const int tid){
+    RandomLevel & rng = levelRngs[tid];
+    if(rng.refreshDue(LEVEL_REFRESH_INSERTS)){
+        int cap = RandomLevel::heightForSize(sizeEstimate.getTotal(), levelProbability, maxLevel-1);
+        rng.setMaxHeight(cap);
+        topHint.store(cap, MOR);
     }
-    return tH;
+    return rng.next();
 }
 
-void MikhailCASBased::listTraversal(){
+template <class Key, class Value, class Compare>
+void MikhailCASBased<Key, Value, Compare>::listTraversal(){
     node *n = head;
     printf("Traversing list from head: ");
     while(n!=NULL){
-        printf("%d ",n->key);
-        n = (node *)((int)n->succ & (~3));
+        printf("%ld ",KT::checksum(n->key));
+        n = n->succ.ptr();
     }
     printf("\n");
 }
 
-int MikhailCASBased::valueTraversal(){
-    node *n = head;
+template <class Key, class Value, class Compare>
+int MikhailCASBased<Key, Value, Compare>::valueTraversal(){
+    node *n = head->succ.ptr();
     int count = 0;
-    //printf("Traversing list from head: ");
-    while(n!=NULL){
-        count++;
-        //printf("%d ",n->value);
-        n = (node *)((int)n->succ & (~3));
+    while(!KT::equal(n->key, KT::maxKey())){
+        if(!n->succ.isMarked()) count++;
+        n = n->succ.ptr();
     }
-    printf("\n");
-    return count-2;
-}
\ No newline at end of file
+    return count;
+}
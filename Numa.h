@@ -0,0 +1,198 @@
+#pragma once
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <iostream>
+#include <sched.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/mempolicy.h>
+
+#include "defines.h"
+
+using namespace std;
+
+/*
+ * Thread and memory placement for the benchmark threads, read from /sys so that no library
+ * is needed. Sockets are NUMA nodes: the node ids are read from /sys/devices/system/node/online,
+ * which may have gaps, and the CPUs of each from node<n>/cpulist; without sysfs every CPU is on
+ * node 0.
+ *   PIN_NONE      leave threads to the scheduler
+ *   PIN_COMPACT   fill the CPUs of node 0 first, then node 1, ...
+ *   PIN_SCATTER   round robin over the nodes, so consecutive tids land on different sockets
+ *   PIN_LIST      thread tid runs on cpuList[tid % size]
+ * The memory policy is set with set_mempolicy by each benchmark thread before it allocates, so
+ * it covers everything that thread allocates while prefilling and while running:
+ *   MEM_FIRST_TOUCH  kernel default, a page lives on the node of the thread that touches it first
+ *   MEM_LOCAL        bound to the node of the CPU the thread is pinned to, or preferred if that
+ *                    node has no memory
+ *   MEM_INTERLEAVE   pages spread round robin over the nodes listed in has_memory
+ */
+
+enum PinPolicy { PIN_NONE = 0, PIN_COMPACT = 1, PIN_SCATTER = 2, PIN_LIST = 3 };
+enum MemPolicy { MEM_FIRST_TOUCH = 0, MEM_LOCAL = 1, MEM_INTERLEAVE = 2 };
+
+class NumaPlacement {
+private:
+    int pinPolicy;
+    int memPolicy;
+    vector<int> cpuOrder;           //CPU for each tid, modulo its size
+    vector<int> nodeOfCpu;
+    vector<int> memoryNodes;        //nodes with memory, for MEM_INTERLEAVE
+    int numNodes;
+    volatile char padding0[PADDING_BYTES];
+    int threadNode[MAX_THREADS];    //node each tid was placed on, -1 if unknown
+    volatile char padding1[PADDING_BYTES];
+
+    static vector<int> parseCpuList(const char *s);
+    static vector<int> readNodeList(const char *name);
+    void readTopology();
+
+public:
+    NumaPlacement();
+
+    //Accepts "compact", "scatter" or a CPU list such as "0-3,8,10"
+    bool setPinPolicy(const char *arg);
+    //Accepts "firsttouch", "local" or "interleave"
+    bool setMemPolicy(const char *arg);
+    //Called by each benchmark thread before it allocates anything
+    void bindThread(const int tid);
+    int nodeOf(const int tid) { return threadNode[tid]; }
+    int getNumNodes() { return numNodes; }
+    bool isPinned() { return pinPolicy != PIN_NONE; }
+    void printConfig();
+};
+
+NumaPlacement::NumaPlacement() : pinPolicy(PIN_NONE), memPolicy(MEM_FIRST_TOUCH), numNodes(1) {
+    for(int tid = 0; tid < MAX_THREADS; tid++) threadNode[tid] = -1;
+    readTopology();
+}
+
+vector<int> NumaPlacement::parseCpuList(const char *s){
+    vector<int> cpus;
+    while(*s != '\0' && *s != '\n'){
+        char *end;
+        int lo = strtol(s, &end, 10);
+        if(end == s) return vector<int>();
+        int hi = lo;
+        s = end;
+        if(*s == '-'){
+            hi = strtol(s+1, &end, 10);
+            s = end;
+        }
+        for(int c = lo; c <= hi; c++) cpus.push_back(c);
+        if(*s == ',') s++;
+    }
+    return cpus;
+}
+
+//Parses a node list such as "0,2-3" from /sys/devices/system/node/<name>; empty if unreadable
+vector<int> NumaPlacement::readNodeList(const char *name){
+    char path[128], buf[4096];
+    snprintf(path, sizeof(path), "/sys/devices/system/node/%s", name);
+    FILE *f = fopen(path, "r");
+    if(f == NULL) return vector<int>();
+    vector<int> nodes;
+    if(fgets(buf, sizeof(buf), f) != NULL) nodes = parseCpuList(buf);
+    fclose(f);
+    return nodes;
+}
+
+void NumaPlacement::readTopology(){
+    int numCpus = sysconf(_SC_NPROCESSORS_CONF);
+    nodeOfCpu.assign(max(numCpus, 1), 0);
+    numNodes = 1;
+    vector<int> nodes = readNodeList("online");
+    for(int node : nodes){
+        if(node < 0 || node >= 1024) continue;      //beyond the set_mempolicy mask
+        char path[128], buf[4096];
+        snprintf(path, sizeof(path), "/sys/devices/system/node/node%d/cpulist", node);
+        FILE *f = fopen(path, "r");
+        if(f == NULL) continue;
+        if(fgets(buf, sizeof(buf), f) != NULL){
+            for(int c : parseCpuList(buf)){
+                if(c >= (int)nodeOfCpu.size()) nodeOfCpu.resize(c+1, 0);
+                nodeOfCpu[c] = node;
+            }
+        }
+        fclose(f);
+        numNodes = max(numNodes, node + 1);
+    }
+    memoryNodes.clear();
+    for(int node : readNodeList("has_memory")) if(node >= 0 && node < numNodes) memoryNodes.push_back(node);
+    if(memoryNodes.empty()){
+        for(int node : nodes) if(node >= 0 && node < numNodes) memoryNodes.push_back(node);
+    }
+    if(memoryNodes.empty()) memoryNodes.push_back(0);
+}
+
+bool NumaPlacement::setPinPolicy(const char *arg){
+    vector<vector<int>> cpusOfNode(numNodes);
+    for(int c = 0; c < (int)nodeOfCpu.size(); c++) cpusOfNode[nodeOfCpu[c]].push_back(c);
+    cpuOrder.clear();
+    if(strcmp(arg, "compact") == 0){
+        pinPolicy = PIN_COMPACT;
+        for(auto & cpus : cpusOfNode) cpuOrder.insert(cpuOrder.end(), cpus.begin(), cpus.end());
+    }else if(strcmp(arg, "scatter") == 0){
+        pinPolicy = PIN_SCATTER;
+        for(size_t i = 0; cpuOrder.size() < nodeOfCpu.size(); i++){
+            for(auto & cpus : cpusOfNode) if(i < cpus.size()) cpuOrder.push_back(cpus[i]);
+        }
+    }else{
+        pinPolicy = PIN_LIST;
+        cpuOrder = parseCpuList(arg);
+        for(int c : cpuOrder) if(c >= (int)nodeOfCpu.size()) return false;
+    }
+    return !cpuOrder.empty();
+}
+
+bool NumaPlacement::setMemPolicy(const char *arg){
+    if(strcmp(arg, "firsttouch") == 0) memPolicy = MEM_FIRST_TOUCH;
+    else if(strcmp(arg, "local") == 0) memPolicy = MEM_LOCAL;
+    else if(strcmp(arg, "interleave") == 0) memPolicy = MEM_INTERLEAVE;
+    else return false;
+    return true;
+}
+
+void NumaPlacement::bindThread(const int tid){
+    int node = -1;
+    if(pinPolicy != PIN_NONE){
+        int cpu = cpuOrder[tid % cpuOrder.size()];
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(cpu, &set);
+        if(sched_setaffinity(0, sizeof(set), &set) != 0) perror("sched_setaffinity");
+        node = nodeOfCpu[cpu];
+    }
+    threadNode[tid] = node;
+    if(memPolicy == MEM_FIRST_TOUCH) return;
+    const int MASK_BITS = 8*sizeof(unsigned long);
+    unsigned long mask[1024 / MASK_BITS] = {0};
+    int mode;
+    if(memPolicy == MEM_LOCAL && node >= 0 && find(memoryNodes.begin(), memoryNodes.end(), node) != memoryNodes.end()){
+        mode = MPOL_BIND;
+        mask[node / MASK_BITS] |= 1UL << (node % MASK_BITS);
+    }else if(memPolicy == MEM_LOCAL){
+        mode = MPOL_PREFERRED;      //empty mask: the nearest node with memory to the CPU it runs on
+    }else{
+        mode = MPOL_INTERLEAVE;
+        for(int n : memoryNodes) mask[n / MASK_BITS] |= 1UL << (n % MASK_BITS);
+    }
+    if(syscall(SYS_set_mempolicy, mode, mask, 1024) != 0) perror("set_mempolicy");
+}
+
+void NumaPlacement::printConfig(){
+    static const char *pinNames[] = {"none", "compact", "scatter", "list"};
+    static const char *memNames[] = {"firsttouch", "local", "interleave"};
+    cout<<"numaNodes="<<numNodes<<endl;
+    cout<<"pinPolicy="<<pinNames[pinPolicy]<<endl;
+    cout<<"memPolicy="<<memNames[memPolicy]<<endl;
+    if(pinPolicy != PIN_NONE){
+        cout<<"cpuOrder=";
+        for(size_t i = 0; i < cpuOrder.size(); i++) cout<<(i ? "," : "")<<cpuOrder[i];
+        cout<<endl;
+    }
+}
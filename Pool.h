@@ -0,0 +1,152 @@
+#pragma once
+#include <cstdlib>
+#include <new>
+#include <vector>
+#include <utility>
+
+#include "defines.h"
+
+using namespace std;
+
+/*
+ * Per-thread slab allocator for nodes and descriptors, keyed by the benchmark tid.
+ * Blocks come in cache-line multiples (64, 128, ... bytes) carved from 64-byte aligned slabs.
+ * A freed block goes onto the free list of the thread that frees it (usually the thread that
+ * reclaims it), so memory recycles without touching the global allocator or any shared word.
+ * Slabs are only returned when the process exits.
+ * allocObject/freeObject use the pool when built with -DUSE_POOL and plain new/delete otherwise.
+ */
+
+#ifndef POOL_SLAB_BYTES
+#define POOL_SLAB_BYTES (1<<20)
+#endif
+
+#define POOL_NUM_CLASSES 8     //64 bytes up to 8KB
+
+class Pool {
+private:
+    struct FreeBlock {
+        FreeBlock *next;
+    };
+    struct ThreadPool {
+        volatile char padding0[PADDING_BYTES];
+        FreeBlock *freeList[POOL_NUM_CLASSES];
+        char *bump;
+        char *bumpEnd;
+        vector<void *> slabs;
+        volatile char padding1[PADDING_BYTES];
+    };
+    ThreadPool pools[MAX_THREADS];
+
+    void refill(ThreadPool & tp);
+
+public:
+    Pool();
+    ~Pool();
+
+    static int sizeClass(size_t size);
+    void *allocate(const int tid, size_t size);
+    void deallocate(const int tid, void *p, size_t size);
+};
+
+Pool::Pool(){
+    for(int tid = 0; tid < MAX_THREADS; tid++){
+        for(int c = 0; c < POOL_NUM_CLASSES; c++) pools[tid].freeList[c] = NULL;
+        pools[tid].bump = pools[tid].bumpEnd = NULL;
+    }
+}
+
+Pool::~Pool(){
+    for(int tid = 0; tid < MAX_THREADS; tid++){
+        for(auto slab : pools[tid].slabs) free(slab);
+    }
+}
+
+int Pool::sizeClass(size_t size){
+    int c = 0;
+    while(c < POOL_NUM_CLASSES && ((size_t)PADDING_BYTES<<c) < size) c++;
+    return c;
+}
+
+void Pool::refill(ThreadPool & tp){
+    char *slab = (char *)aligned_alloc(PADDING_BYTES, POOL_SLAB_BYTES);
+    if(slab == NULL) throw bad_alloc();
+    tp.slabs.push_back(slab);
+    tp.bump = slab;
+    tp.bumpEnd = slab + POOL_SLAB_BYTES;
+}
+
+void *Pool::allocate(const int tid, size_t size){
+    int c = sizeClass(size);
+    if(c == POOL_NUM_CLASSES){
+        void *p = aligned_alloc(PADDING_BYTES, (size + PADDING_BYTES - 1) & ~(size_t)(PADDING_BYTES - 1));
+        if(p == NULL) throw bad_alloc();
+        return p;
+    }
+    ThreadPool & tp = pools[tid];
+    FreeBlock *b = tp.freeList[c];
+    if(b != NULL){
+        tp.freeList[c] = b->next;
+        return b;
+    }
+    size_t blockSize = (size_t)PADDING_BYTES<<c;
+    if(tp.bump + blockSize > tp.bumpEnd) refill(tp);
+    void *p = tp.bump;
+    tp.bump += blockSize;
+    return p;
+}
+
+void Pool::deallocate(const int tid, void *p, size_t size){
+    int c = sizeClass(size);
+    if(c == POOL_NUM_CLASSES){
+        free(p);
+        return;
+    }
+    ThreadPool & tp = pools[tid];
+    FreeBlock *b = (FreeBlock *)p;
+    b->next = tp.freeList[c];
+    tp.freeList[c] = b;
+}
+
+inline Pool & globalPool(){
+    static Pool pool;
+    return pool;
+}
+
+template <class T, class... Args>
+T *allocObject(const int tid, Args&&... args){
+#ifdef USE_POOL
+    return new (globalPool().allocate(tid, sizeof(T))) T(forward<Args>(args)...);
+#else
+    return new T(forward<Args>(args)...);
+#endif
+}
+
+template <class T>
+void freeObject(const int tid, T *p){
+#ifdef USE_POOL
+    p->~T();
+    globalPool().deallocate(tid, p, sizeof(T));
+#else
+    delete p;
+#endif
+}
+
+//Variable-sized objects (e.g. nodes with an inline tower); the same size must be passed to freeBytes
+inline void *allocBytes(const int tid, size_t size){
+#ifdef USE_POOL
+    return globalPool().allocate(tid, size);
+#else
+    void *p = aligned_alloc(PADDING_BYTES, (size + PADDING_BYTES - 1) & ~(size_t)(PADDING_BYTES - 1));
+    if(p == NULL) throw bad_alloc();
+    return p;
+#endif
+}
+
+inline void freeBytes(const int tid, void *p, size_t size){
+#ifdef USE_POOL
+    globalPool().deallocate(tid, p, size);
+#else
+    free(p);
+#endif
+}
@@ -0,0 +1,248 @@
+#pragma once
+#include <atomic>
+#include <vector>
+#include <algorithm>
+
+#include "defines.h"
+#include "Pool.h"
+
+using namespace std;
+
+/*
+ * Safe memory reclamation for skip-list nodes and MCAS/CCAS descriptors.
+ * Every operation runs inside a Guard for its tid. An object is retired once it has been
+ * unlinked and is destroyed only when no thread that could still hold it is active.
+ * EpochReclaimer is the one in use. HazardReclaimer needs every shared pointer to be protect()ed
+ * and revalidated before it is used, which the lists and the recursive MCAS/CCAS helpers do not
+ * do yet, so selecting it with -DUSE_HAZARD_POINTERS is rejected at compile time.
+ */
+
+#ifndef RECLAIM_SCAN_INTERVAL
+#define RECLAIM_SCAN_INTERVAL 64
+#endif
+
+#ifndef HP_SLOTS
+#define HP_SLOTS 16
+#endif
+
+struct RetiredObject {
+    void *p;
+    void (*destroy)(const int, void *);
+};
+
+template <class T>
+void destroyObject(const int tid, void *p){
+    freeObject(tid, (T *)p);
+}
+
+class EpochReclaimer {
+private:
+    struct ThreadData {
+        volatile char padding0[PADDING_BYTES];
+        atomic<uint64_t> announce;      //(epoch<<1)|1 while the thread is inside an operation
+        uint64_t localEpoch;
+        uint64_t bagEpoch[4];
+        vector<RetiredObject> bags[4];
+        int opsSinceScan;
+        volatile char padding1[PADDING_BYTES];
+    };
+    volatile char padding0[PADDING_BYTES];
+    const int numThreads;
+    volatile char padding1[PADDING_BYTES];
+    atomic<uint64_t> epoch;
+    volatile char padding2[PADDING_BYTES];
+    ThreadData threadData[MAX_THREADS];
+    volatile char padding3[PADDING_BYTES];
+
+    void freeBag(const int tid, vector<RetiredObject> & bag);
+    void tryAdvance();
+
+public:
+    EpochReclaimer(const int _numThreads);
+    ~EpochReclaimer();
+
+    void startOp(const int tid);
+    void endOp(const int tid);
+    void protect(const int tid, const int slot, void *p) {}
+    template <class T> void retire(const int tid, T *p, void (*destroy)(const int, void *) = destroyObject<T>);
+    long long getPendingCount();
+};
+
+EpochReclaimer::EpochReclaimer(const int _numThreads)
+        : numThreads(_numThreads) {
+    epoch = 0;
+    for(int tid = 0; tid < MAX_THREADS; tid++){
+        threadData[tid].announce = 0;
+        threadData[tid].localEpoch = 0;
+        threadData[tid].opsSinceScan = 0;
+        for(int i = 0; i < 4; i++) threadData[tid].bagEpoch[i] = 0;
+    }
+}
+
+EpochReclaimer::~EpochReclaimer(){
+    for(int tid = 0; tid < MAX_THREADS; tid++){
+        for(int i = 0; i < 4; i++) freeBag(tid, threadData[tid].bags[i]);
+    }
+}
+
+void EpochReclaimer::freeBag(const int tid, vector<RetiredObject> & bag){
+    for(auto & r : bag) r.destroy(tid, r.p);
+    bag.clear();
+}
+
+//Objects are freed three epochs after they were retired rather than two: a CCAS descriptor
+//installed by a lagging helper can expose an already retired MCAS descriptor for one more epoch.
+//The announcement is only trusted once the epoch is re-read unchanged after it: a thread that
+//announced an epoch already passed could otherwise retire into a bag older than what others hold.
+void EpochReclaimer::startOp(const int tid){
+    ThreadData & td = threadData[tid];
+    uint64_t e = epoch.load(memory_order_acquire);
+    while(true){
+        td.announce.store((e<<1)|1);
+        uint64_t now = epoch.load();
+        if(now == e) break;
+        e = now;
+    }
+    if(e != td.localEpoch){
+        for(int i = 0; i < 4; i++){
+            if(td.bagEpoch[i] + 3 <= e) freeBag(tid, td.bags[i]);
+        }
+        td.localEpoch = e;
+        td.bagEpoch[e%4] = e;
+    }
+    if(++td.opsSinceScan >= RECLAIM_SCAN_INTERVAL){
+        td.opsSinceScan = 0;
+        tryAdvance();
+    }
+}
+
+void EpochReclaimer::endOp(const int tid){
+    ThreadData & td = threadData[tid];
+    td.announce.store(td.localEpoch<<1, memory_order_release);
+}
+
+void EpochReclaimer::tryAdvance(){
+    uint64_t e = epoch.load();
+    for(int tid = 0; tid < numThreads; tid++){
+        uint64_t a = threadData[tid].announce.load();
+        if((a & 1) && (a>>1) != e) return;
+    }
+    epoch.compare_exchange_strong(e, e+1);
+}
+
+template <class T>
+void EpochReclaimer::retire(const int tid, T *p, void (*destroy)(const int, void *)){
+    ThreadData & td = threadData[tid];
+    td.bags[td.localEpoch%4].push_back({(void *)p, destroy});
+}
+
+long long EpochReclaimer::getPendingCount(){
+    long long result = 0;
+    for(int tid = 0; tid < MAX_THREADS; tid++){
+        for(int i = 0; i < 4; i++) result += threadData[tid].bags[i].size();
+    }
+    return result;
+}
+
+class HazardReclaimer {
+private:
+    struct ThreadData {
+        volatile char padding0[PADDING_BYTES];
+        atomic<void *> hazards[HP_SLOTS];
+        vector<RetiredObject> retired;
+        vector<void *> scratch;
+        volatile char padding1[PADDING_BYTES];
+    };
+    volatile char padding0[PADDING_BYTES];
+    const int numThreads;
+    const size_t threshold;
+    volatile char padding1[PADDING_BYTES];
+    ThreadData threadData[MAX_THREADS];
+    volatile char padding2[PADDING_BYTES];
+
+    void scan(const int tid);
+
+public:
+    HazardReclaimer(const int _numThreads);
+    ~HazardReclaimer();
+
+    void startOp(const int tid) {}
+    void endOp(const int tid);
+    void protect(const int tid, const int slot, void *p);
+    template <class T> void retire(const int tid, T *p, void (*destroy)(const int, void *) = destroyObject<T>);
+    long long getPendingCount();
+};
+
+HazardReclaimer::HazardReclaimer(const int _numThreads)
+        : numThreads(_numThreads), threshold(max(64, 2*_numThreads*HP_SLOTS)) {
+    for(int tid = 0; tid < MAX_THREADS; tid++){
+        for(int i = 0; i < HP_SLOTS; i++) threadData[tid].hazards[i] = NULL;
+    }
+}
+
+HazardReclaimer::~HazardReclaimer(){
+    for(int tid = 0; tid < MAX_THREADS; tid++){
+        for(auto & r : threadData[tid].retired) r.destroy(tid, r.p);
+    }
+}
+
+void HazardReclaimer::endOp(const int tid){
+    for(int i = 0; i < HP_SLOTS; i++) threadData[tid].hazards[i].store(NULL, memory_order_release);
+}
+
+void HazardReclaimer::protect(const int tid, const int slot, void *p){
+    threadData[tid].hazards[slot].store(p);
+}
+
+template <class T>
+void HazardReclaimer::retire(const int tid, T *p, void (*destroy)(const int, void *)){
+    ThreadData & td = threadData[tid];
+    td.retired.push_back({(void *)p, destroy});
+    if(td.retired.size() >= threshold) scan(tid);
+}
+
+void HazardReclaimer::scan(const int tid){
+    ThreadData & td = threadData[tid];
+    td.scratch.clear();
+    for(int t = 0; t < numThreads; t++){
+        for(int i = 0; i < HP_SLOTS; i++){
+            void *p = threadData[t].hazards[i].load();
+            if(p != NULL) td.scratch.push_back(p);
+        }
+    }
+    sort(td.scratch.begin(), td.scratch.end());
+    size_t kept = 0;
+    for(size_t i = 0; i < td.retired.size(); i++){
+        if(binary_search(td.scratch.begin(), td.scratch.end(), td.retired[i].p)){
+            td.retired[kept++] = td.retired[i];
+        }else{
+            td.retired[i].destroy(tid, td.retired[i].p);
+        }
+    }
+    td.retired.resize(kept);
+}
+
+long long HazardReclaimer::getPendingCount(){
+    long long result = 0;
+    for(int tid = 0; tid < MAX_THREADS; tid++) result += threadData[tid].retired.size();
+    return result;
+}
+
+#ifdef USE_HAZARD_POINTERS
+#error "USE_HAZARD_POINTERS is not supported yet: traversals and MCAS helpers do not protect what they read"
+#endif
+typedef EpochReclaimer Reclaimer;
+
+//Opens an operation for tid on construction and closes it on destruction.
+class Guard {
+private:
+    Reclaimer *reclaimer;
+    const int tid;
+public:
+    Guard(Reclaimer *_reclaimer, const int _tid) : reclaimer(_reclaimer), tid(_tid) {
+        reclaimer->startOp(tid);
+    }
+    ~Guard() {
+        reclaimer->endOp(tid);
+    }
+};
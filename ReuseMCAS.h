@@ -0,0 +1,363 @@
+#pragma once
+#include <atomic>
+#include <vector>
+#include "defines.h"
+#include "CCAS.h"
+#include "Reclaimer.h"
+
+using namespace std;
+
+/*
+ * MCAS with per-thread reusable descriptors ("reuse, don't recycle", Arbel-Raviv and Brown).
+ * Each thread owns one MCAS descriptor and one RDCSS descriptor and reuses them for every
+ * operation, so nothing is allocated or reclaimed. A descriptor pointer in a word is
+ * replaced by a tagged (seq, tid) pair; a helper copies the descriptor's fields and then
+ * checks that its sequence number is unchanged, otherwise the operation it wanted to help
+ * has already finished and the copy is discarded.
+ * Words hold values shifted left by two exactly as in MCAS, so the two engines are
+ * interchangeable behind doMCAS/MCASRead/valueRead/valueWrite.
+ * The entries of an MCAS descriptor live in an array that starts with room for the tallest
+ * skip list update and is replaced by one twice as large when an operation needs more; the old
+ * array is retired, so helpers must run inside a Guard, as every operation on the lists does, and
+ * protect the array before reading it. Helpers copy larger operations into per-thread scratch
+ * buffers, one for each level of nested helping, which only ever grow.
+ */
+
+//Hazard pointer slot covering the entries array being copied
+#define HP_ENTRIES_SLOT (HP_SLOTS-3)
+
+class ReuseMCAS{
+private:
+    static const int64 MCAS_TAG = 1;
+    static const int64 RDCSS_TAG = 2;
+    static const int TID_SHIFT = 2;
+    static const int SEQ_SHIFT = 10;
+    static const uint64_t SEQ_MASK = (~0ULL)>>SEQ_SHIFT;
+
+    struct RDCSSDesc{
+        volatile char padding0[PADDING_BYTES];
+        atomic<uint64_t> seq;
+        atomic<atomic<uint64_t> *> a1;    //status word of the MCAS being installed
+        atomic<uint64_t> o1;
+        atomic<int64 *> a2;
+        atomic<int64> o2, n2;
+        volatile char padding1[PADDING_BYTES];
+    };
+    struct MCASEntry{
+        atomic<int64 *> a;
+        atomic<int64> e, n;
+    };
+    struct MCASEntries{
+        int capacity;
+        MCASEntry entries[];
+    };
+    struct MCASDesc{
+        volatile char padding0[PADDING_BYTES];
+        atomic<uint64_t> mutables;        //(seq<<2)|STATUS
+        atomic<int> N;
+        atomic<MCASEntries *> entries;
+        volatile char padding1[PADDING_BYTES];
+    };
+    //Copy of an entry taken by MCASHelp
+    struct Entry{
+        int64 *a;
+        int64 e, n;
+    };
+    struct HelpScratch{
+        volatile char padding0[PADDING_BYTES];
+        vector<vector<Entry>> levels;
+        int depth;
+        volatile char padding1[PADDING_BYTES];
+    };
+    static const int INLINE_ENTRIES = 2*NR_LEVELS+1;
+    volatile char padding0[PADDING_BYTES];
+    RDCSSDesc rdcssDescs[MAX_THREADS];
+    MCASDesc mcasDescs[MAX_THREADS];
+    HelpScratch scratch[MAX_THREADS];
+    Reclaimer *reclaimer;
+    volatile char padding1[PADDING_BYTES];
+
+    static int64 tag(uint64_t seq, int tid, int64 type) { return (int64)(((seq & SEQ_MASK)<<SEQ_SHIFT) | ((uint64_t)tid<<TID_SHIFT) | type); }
+    static int tidOf(int64 tagged) { return (int)(((uint64_t)tagged>>TID_SHIFT) & (MAX_THREADS-1)); }
+    static uint64_t seqOf(int64 tagged) { return (uint64_t)tagged>>SEQ_SHIFT; }
+    bool IsRDCSSDesc(int64 d) { return d & RDCSS_TAG; }
+
+    static size_t entriesBytes(const int capacity) { return sizeof(MCASEntries) + capacity*sizeof(MCASEntry); }
+    static MCASEntries *allocEntries(const int tid, const int capacity);
+    MCASEntries *protectEntries(const int tid, MCASDesc & d);
+    static void destroyEntries(const int tid, void *p);
+    int64 RDCSS(const int tid, atomic<uint64_t> *a1, uint64_t o1, int64 *a2, int64 o2, int64 n2);
+    void RDCSSHelp(int64 tagged);
+    bool doCAS(const int tid, int64 *a, int64 e, int64 n);
+
+public:
+    ReuseMCAS(Reclaimer *_reclaimer);
+    ~ReuseMCAS();
+
+    bool IsMCASDesc(int64 d);
+    bool doMCAS(const int tid, int64 *a[], int64 e[], int64 n[], int N);
+    int64 MCASRead(const int tid, int64 *a);
+    //Logical value of *a without helping or writing to shared memory
+    int64 MCASReadNoHelp(const int tid, int64 *a);
+    bool MCASHelp(const int tid, int64 tagged);
+    void valueWrite(int64 *a, int64 b);
+    void valueWriteInt(int64 *a, int64 b);
+    int64 valueRead(const int tid, int64 *a);
+    int64 valueReadNoHelp(const int tid, int64 *a);
+};
+
+static_assert((MAX_THREADS & (MAX_THREADS-1)) == 0 && MAX_THREADS <= 256, "ReuseMCAS packs tids into 8 bits");
+
+ReuseMCAS::ReuseMCAS(Reclaimer *_reclaimer) : reclaimer(_reclaimer){
+    for(int tid = 0; tid < MAX_THREADS; tid++){
+        rdcssDescs[tid].seq = 0;
+        mcasDescs[tid].mutables = (uint64_t)SUCCEEDED;
+        mcasDescs[tid].N = 0;
+        mcasDescs[tid].entries = allocEntries(0, INLINE_ENTRIES);
+        scratch[tid].depth = 0;
+    }
+}
+
+ReuseMCAS::~ReuseMCAS(){
+    for(int tid = 0; tid < MAX_THREADS; tid++) destroyEntries(0, mcasDescs[tid].entries.load(MOR));
+}
+
+ReuseMCAS::MCASEntries *ReuseMCAS::allocEntries(const int tid, const int capacity){
+    MCASEntries *m = (MCASEntries *)allocBytes(tid, entriesBytes(capacity));
+    m->capacity = capacity;
+    for(int i = 0; i < capacity; i++) new (&m->entries[i]) MCASEntry();
+    return m;
+}
+
+void ReuseMCAS::destroyEntries(const int tid, void *p){
+    MCASEntries *m = (MCASEntries *)p;
+    freeBytes(tid, m, entriesBytes(m->capacity));
+}
+
+//The owner may swap the array and retire the old one at any time
+ReuseMCAS::MCASEntries *ReuseMCAS::protectEntries(const int tid, MCASDesc & d){
+    MCASEntries *x = d.entries.load(memory_order_acquire);
+    while(true){
+        reclaimer->protect(tid, HP_ENTRIES_SLOT, x);
+        MCASEntries *again = d.entries.load(memory_order_acquire);
+        if(again == x) return x;
+        x = again;
+    }
+}
+
+//Installs a descriptor in a2 only while *a1 == o1, otherwise leaves o2; returns what a2 held.
+int64 ReuseMCAS::RDCSS(const int tid, atomic<uint64_t> *a1, uint64_t o1, int64 *a2, int64 o2, int64 n2){
+    RDCSSDesc & d = rdcssDescs[tid];
+    uint64_t seq = d.seq.load(MOR) + 1;
+    d.seq.store(seq, MOR);
+    atomic_thread_fence(memory_order_release);
+    d.a1.store(a1, MOR);
+    d.o1.store(o1, MOR);
+    d.a2.store(a2, MOR);
+    d.o2.store(o2, MOR);
+    d.n2.store(n2, MOR);
+    int64 tagged = tag(seq, tid, RDCSS_TAG);
+    while(true){
+        int64 r = __sync_val_compare_and_swap(a2, o2, tagged);
+        if(IsRDCSSDesc(r)){
+            STAT_INC(tid, CCAS_HELPS);
+            RDCSSHelp(r);
+            continue;
+        }
+        if(r == o2) RDCSSHelp(tagged);
+        return r;
+    }
+}
+
+void ReuseMCAS::RDCSSHelp(int64 tagged){
+    RDCSSDesc & d = rdcssDescs[tidOf(tagged)];
+    atomic<uint64_t> *a1 = d.a1.load(MOR);
+    uint64_t o1 = d.o1.load(MOR);
+    int64 *a2 = d.a2.load(MOR);
+    int64 o2 = d.o2.load(MOR);
+    int64 n2 = d.n2.load(MOR);
+    atomic_thread_fence(memory_order_acquire);
+    if((d.seq.load(MOR) & SEQ_MASK) != seqOf(tagged)) return;   //already completed and reused
+    bool success = (a1->load() == o1);
+    __sync_bool_compare_and_swap(a2, tagged, success? n2 : o2);
+}
+
+//A single word needs no descriptor: a plain CAS fails on a word that holds one, which is then
+//helped out of the way before retrying
+bool ReuseMCAS::doCAS(const int tid, int64 *a, int64 e, int64 n){
+    STAT_INC(tid, MCAS_OPS);
+    while(true){
+        int64 v = __sync_val_compare_and_swap(a, e, n);
+        if(v == e) return true;
+        if(!IsMCASDesc(v) && !IsRDCSSDesc(v)){
+            STAT_INC(tid, MCAS_FAILURES);
+            return false;
+        }
+        MCASRead(tid, a);
+    }
+}
+
+bool ReuseMCAS::doMCAS(const int tid, int64 *a[], int64 e[], int64 n[], int N){
+    if(N == 1) return doCAS(tid, a[0], e[0]<<2, n[0]<<2);
+    MCASDesc & d = mcasDescs[tid];
+    uint64_t seq = (d.mutables.load(MOR)>>2) + 1;
+    d.mutables.store((seq<<2)|UNDECIDED, MOR);
+    atomic_thread_fence(memory_order_release);
+    MCASEntries *m = d.entries.load(MOR);
+    if(N > m->capacity){
+        MCASEntries *bigger = allocEntries(tid, max(N, 2*m->capacity));
+        d.entries.store(bigger, memory_order_release);
+        reclaimer->retire(tid, m, destroyEntries);
+        m = bigger;
+    }
+    //Keep entries sorted by address as they are added
+    MCASEntry *x = m->entries;
+    for(int i = 0; i < N; i++){
+        int j = i;
+        for(; j > 0 && (int64)x[j-1].a.load(MOR) > (int64)a[i]; j--){
+            x[j].a.store(x[j-1].a.load(MOR), MOR);
+            x[j].e.store(x[j-1].e.load(MOR), MOR);
+            x[j].n.store(x[j-1].n.load(MOR), MOR);
+        }
+        x[j].a.store(a[i], MOR);
+        x[j].e.store(e[i]<<2, MOR);
+        x[j].n.store(n[i]<<2, MOR);
+    }
+    d.N.store(N, MOR);
+    bool result = MCASHelp(tid, tag(seq, tid, MCAS_TAG));
+    STAT_INC(tid, MCAS_OPS);
+    if(!result) STAT_INC(tid, MCAS_FAILURES);
+    return result;
+}
+
+bool ReuseMCAS::MCASHelp(const int tid, int64 tagged){
+    MCASDesc & d = mcasDescs[tidOf(tagged)];
+    uint64_t seq = seqOf(tagged);
+    //N and the array may belong to a later operation; the sequence check below discards the copy
+    MCASEntries *x = protectEntries(tid, d);
+    int N = min(d.N.load(MOR), x->capacity);
+    Entry inlineCopy[INLINE_ENTRIES];
+    Entry *c = inlineCopy;
+    HelpScratch & s = scratch[tid];
+    const bool useScratch = (N > INLINE_ENTRIES);
+    if(useScratch){
+        if(s.depth == (int)s.levels.size()) s.levels.emplace_back();
+        vector<Entry> & level = s.levels[s.depth++];
+        if((int)level.size() < N) level.resize(N);
+        c = level.data();
+    }
+    for(int i = 0; i < N; i++){
+        c[i].a = x->entries[i].a.load(MOR);
+        c[i].e = x->entries[i].e.load(MOR);
+        c[i].n = x->entries[i].n.load(MOR);
+    }
+    atomic_thread_fence(memory_order_acquire);
+    uint64_t m = d.mutables.load(MOR);
+    if(((m>>2) & SEQ_MASK) != seq){
+        if(useScratch) s.depth--;
+        return false;
+    }
+    uint64_t undecided = (m & ~3ULL)|UNDECIDED;
+
+    if((m & 3) == UNDECIDED){
+        STATUS desired = SUCCEEDED;
+        for(int i = 0; i < N && desired == SUCCEEDED; i++){
+            while(true){
+                int64 v = *(volatile int64 *)c[i].a;
+                //A plain mismatch fails the MCAS without writing to the word
+                if(!IsMCASDesc(v) && !IsRDCSSDesc(v) && v != c[i].e){
+                    desired = FAILED;
+                    break;
+                }
+                v = RDCSS(tid, &d.mutables, undecided, c[i].a, c[i].e, tagged);
+                if(v == c[i].e || v == tagged) break;
+                if(IsMCASDesc(v)){
+                    STAT_INC(tid, MCAS_HELPS);
+                    MCASHelp(tid, v);
+                    continue;
+                }
+                desired = FAILED;
+                break;
+            }
+        }
+        d.mutables.compare_exchange_strong(undecided, (undecided & ~3ULL)|desired);
+    }
+    m = d.mutables.load();
+    bool success = false;
+    if(((m>>2) & SEQ_MASK) == seq){
+        success = ((m & 3) == SUCCEEDED);
+        for(int i = 0; i < N; i++){
+            __sync_bool_compare_and_swap(c[i].a, tagged, success? c[i].n : c[i].e);
+        }
+    }
+    if(useScratch) s.depth--;
+    return success;
+}
+
+int64 ReuseMCAS::MCASRead(const int tid, int64 *a){
+    while(true){
+        int64 v = *(volatile int64 *)a;
+        if(!IsRDCSSDesc(v) && !IsMCASDesc(v)) return v;
+        STAT_INC(tid, DESCRIPTOR_READS);
+        if(IsRDCSSDesc(v)){
+            STAT_INC(tid, CCAS_HELPS);
+            RDCSSHelp(v);
+        }else{
+            STAT_INC(tid, MCAS_HELPS);
+            MCASHelp(tid, v);
+        }
+    }
+}
+
+//Copies what the descriptor says about a and keeps it only if the descriptor still belongs to the
+//operation that was in the word, exactly as the helpers do. An RDCSS descriptor stands for the
+//value it replaced; an MCAS descriptor for its new value once that operation has succeeded and
+//its expected value otherwise. A word is released only after the decision, so the read
+//linearizes at its load or at the decision in between. A changed sequence number means the
+//operation finished meanwhile and the word is read again.
+int64 ReuseMCAS::MCASReadNoHelp(const int tid, int64 *a){
+    while(true){
+        int64 v = *(volatile int64 *)a;
+        if(!IsRDCSSDesc(v) && !IsMCASDesc(v)) return v;
+        STAT_INC(tid, DESCRIPTOR_READS);
+        if(IsRDCSSDesc(v)){
+            RDCSSDesc & d = rdcssDescs[tidOf(v)];
+            int64 o2 = d.o2.load(MOR);
+            atomic_thread_fence(memory_order_acquire);
+            if((d.seq.load(MOR) & SEQ_MASK) == seqOf(v)) return o2;
+            continue;
+        }
+        MCASDesc & d = mcasDescs[tidOf(v)];
+        MCASEntries *x = protectEntries(tid, d);
+        int N = min(d.N.load(MOR), x->capacity);
+        int i = 0;
+        while(i < N && x->entries[i].a.load(MOR) != a) i++;
+        if(i == N) continue;
+        int64 e = x->entries[i].e.load(MOR), n = x->entries[i].n.load(MOR);
+        atomic_thread_fence(memory_order_acquire);
+        uint64_t m = d.mutables.load(MOR);
+        if(((m>>2) & SEQ_MASK) != seqOf(v)) continue;
+        return ((m & 3) == SUCCEEDED) ? n : e;
+    }
+}
+
+bool ReuseMCAS::IsMCASDesc(int64 d){
+    return d & MCAS_TAG;
+}
+
+void ReuseMCAS::valueWrite(int64 *a, int64 b){
+    *a = b<<2;
+}
+
+void ReuseMCAS::valueWriteInt(int64 *a, int64 b){
+    *a = b;
+}
+
+int64 ReuseMCAS::valueRead(const int tid, int64 *a){
+    int64 v = MCASRead(tid, a);
+    return v>>2;
+}
+
+int64 ReuseMCAS::valueReadNoHelp(const int tid, int64 *a){
+    return MCASReadNoHelp(tid, a)>>2;
+}
@@ -0,0 +1,119 @@
+#pragma once
+#include <atomic>
+
+#include "defines.h"
+#include "util.h"
+
+using namespace std;
+
+/*
+ * Striped update counters that let a scan prove no update touched its key range while it ran.
+ * Keys are passed as int64 values in key order (KeyTraits::scanKey). An update to key k
+ * increments started[stripe(k)] before its linearization point and finished[stripe(k)]
+ * after it. A scan of [lo, hi] begins only when no stripe covering the
+ * range has an update in flight, and is valid if no update started on those stripes before it
+ * was validated. Updates to other stripes never invalidate the scan, but stripes repeat every
+ * SCAN_STRIPES << SCAN_STRIPE_SHIFT keys, so distant keys can.
+ * A scan that keeps failing can block its stripes instead: blockRange stops updates from starting
+ * there and waits for those in flight, so the next scan is valid; updates on blocked stripes wait
+ * in startUpdate until unblockRange. An updater announces itself before it looks for a blocker and
+ * the blocker before it waits for updaters, so one of them always sees the other.
+ */
+
+#ifndef SCAN_STRIPES
+#define SCAN_STRIPES 1024           //power of two
+#endif
+
+#ifndef SCAN_STRIPE_SHIFT
+#define SCAN_STRIPE_SHIFT 6         //64 consecutive keys share a stripe
+#endif
+
+class ScanVersions {
+private:
+    struct Stripe {
+        atomic<uint64_t> started;
+        atomic<uint64_t> finished;
+        atomic<int> blockers;
+        volatile char padding[PADDING_BYTES-2*sizeof(atomic<uint64_t>)-sizeof(atomic<int>)];
+    };
+    Stripe stripes[SCAN_STRIPES];
+
+    static int stripeOf(const int64 key) { return (int)(((uint64_t)key>>SCAN_STRIPE_SHIFT) & (SCAN_STRIPES-1)); }
+    static int stripesIn(const int64 lo, const int64 hi);
+
+public:
+    ScanVersions();
+
+    void startUpdate(const int64 key);
+    void finishUpdate(const int64 key);
+    bool beginScan(const int64 lo, const int64 hi, uint64_t & token);
+    bool validateScan(const int64 lo, const int64 hi, const uint64_t token);
+    void blockRange(const int64 lo, const int64 hi);
+    void unblockRange(const int64 lo, const int64 hi);
+} __attribute__((aligned(PADDING_BYTES)));
+
+ScanVersions::ScanVersions(){
+    for(int i = 0; i < SCAN_STRIPES; i++){
+        stripes[i].started = 0;
+        stripes[i].finished = 0;
+        stripes[i].blockers = 0;
+    }
+}
+
+int ScanVersions::stripesIn(const int64 lo, const int64 hi){
+    long long n = (hi>>SCAN_STRIPE_SHIFT) - (lo>>SCAN_STRIPE_SHIFT) + 1;
+    return (n > SCAN_STRIPES) ? SCAN_STRIPES : (int)n;
+}
+
+//An update that finds its stripe blocked backs out as if it had finished, then waits
+void ScanVersions::startUpdate(const int64 key){
+    Stripe & s = stripes[stripeOf(key)];
+    while(true){
+        s.started.fetch_add(1);
+        if(s.blockers.load() == 0) return;
+        s.finished.fetch_add(1, memory_order_release);
+        while(s.blockers.load(memory_order_acquire) != 0) cpuRelax();
+    }
+}
+
+void ScanVersions::finishUpdate(const int64 key){
+    stripes[stripeOf(key)].finished.fetch_add(1, memory_order_release);
+}
+
+//Reads finished before started so that equal counts mean nothing was in flight at the second read
+bool ScanVersions::beginScan(const int64 lo, const int64 hi, uint64_t & token){
+    token = 0;
+    int n = stripesIn(lo, hi);
+    for(int i = 0, s = stripeOf(lo); i < n; i++, s = (s+1) & (SCAN_STRIPES-1)){
+        uint64_t finished = stripes[s].finished.load(memory_order_acquire);
+        uint64_t started = stripes[s].started.load();
+        if(started != finished) return false;
+        token += started;
+    }
+    return true;
+}
+
+void ScanVersions::blockRange(const int64 lo, const int64 hi){
+    int n = stripesIn(lo, hi);
+    for(int i = 0, s = stripeOf(lo); i < n; i++, s = (s+1) & (SCAN_STRIPES-1)) stripes[s].blockers.fetch_add(1);
+    for(int i = 0, s = stripeOf(lo); i < n; i++, s = (s+1) & (SCAN_STRIPES-1)){
+        while(stripes[s].finished.load() != stripes[s].started.load()) cpuRelax();
+    }
+}
+
+void ScanVersions::unblockRange(const int64 lo, const int64 hi){
+    int n = stripesIn(lo, hi);
+    for(int i = 0, s = stripeOf(lo); i < n; i++, s = (s+1) & (SCAN_STRIPES-1)){
+        stripes[s].blockers.fetch_sub(1, memory_order_release);
+    }
+}
+
+bool ScanVersions::validateScan(const int64 lo, const int64 hi, const uint64_t token){
+    atomic_thread_fence(memory_order_acquire);
+    uint64_t sum = 0;
+    int n = stripesIn(lo, hi);
+    for(int i = 0, s = stripeOf(lo); i < n; i++, s = (s+1) & (SCAN_STRIPES-1)){
+        sum += stripes[s].started.load();
+    }
+    return sum == token;
+}
@@ -0,0 +1,499 @@
+#pragma once
+#include <algorithm>
+#include <cstdio>
+#include <iostream>
+#include <type_traits>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+#include "../defines.h"
+#include "../util.h"
+#include "../Pool.h"
+#include "../Reclaimer.h"
+#include "../KeyTraits.h"
+#include "../Stats.h"
+
+using namespace std;
+
+/*
+ * Skip vector: a skip list whose nodes are chunks of up to CHUNK_KEYS keys, in the spirit of
+ * Spear et al.'s skip vectors, on the same MCAS engines as TowerMCASBased. A chunk covers the keys
+ * from its fence, which never changes, up to the fence of its successor on the bottom level, and
+ * holds them unsorted in MCAS words, so a lookup compares the key against the whole chunk at once
+ * (AVX2 or SSE4.1 when the CPU has them, a scalar loop otherwise).
+ * Every MCAS that puts keys into a chunk or moves keys out of it also increments the chunk's
+ * version word: inserting into a free slot, splitting a full chunk (the upper half moves to a new
+ * chunk linked after it) and merging a nearly empty chunk into its predecessor (the chunk is then
+ * unlinked on every level and its succ words marked, as in TowerMCASBased). Erasing a key only
+ * clears its slot and updating a value only rewrites its value word, guarded by the key word, so
+ * neither conflicts with readers. contains reads the version, checks that the chunk still covers
+ * the key, scans it and rereads the version; equal versions mean the chunk held exactly the keys
+ * scanned when the succ word was read. Readers go through valueReadNoHelp and write nothing.
+ * Keys are integers of at most 32 bits and values inline ValueCodec words, because both are
+ * copied between chunks as plain words; keys must lie strictly between minKey() and maxKey(),
+ * and maxKey() marks a free slot. The head chunk holds keys too and is never merged away.
+ */
+
+#ifndef CHUNK_KEYS
+#define CHUNK_KEYS 16                   //multiple of 4
+#endif
+#define CHUNK_LEVEL_REFRESH 16          //splits per thread between recomputing its height cap
+#define CHUNK_ABSENT (-1)
+#define CHUNK_DESCRIPTOR (-2)           //a word held a descriptor, so the scan must read words one by one
+
+static_assert(CHUNK_KEYS % 4 == 0 && CHUNK_KEYS <= 32, "chunk scans compare four 64-bit words at a time into a 32-bit mask");
+
+//Slot of target among the raw MCAS words of a chunk, CHUNK_ABSENT or CHUNK_DESCRIPTOR
+inline int scanChunkScalar(const int64 *words, const int64 target){
+    int64 tags = 0;
+    int slot = CHUNK_ABSENT;
+    for(int i = 0; i < CHUNK_KEYS; i++){
+        int64 w = ((volatile int64 *)words)[i];
+        tags |= w;
+        if(w == target) slot = i;
+    }
+    return (tags & 3) ? CHUNK_DESCRIPTOR : slot;
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+__attribute__((target("avx2")))
+inline int scanChunkAVX2(const int64 *words, const int64 target){
+    const __m256i t = _mm256_set1_epi64x(target);
+    __m256i tags = _mm256_setzero_si256();
+    unsigned mask = 0;
+    for(int i = 0; i < CHUNK_KEYS; i += 4){
+        __m256i w = _mm256_loadu_si256((const __m256i *)(words + i));
+        tags = _mm256_or_si256(tags, w);
+        mask |= (unsigned)_mm256_movemask_pd(_mm256_castsi256_pd(_mm256_cmpeq_epi64(w, t))) << i;
+    }
+    if(!_mm256_testz_si256(tags, _mm256_set1_epi64x(3))) return CHUNK_DESCRIPTOR;
+    return mask ? __builtin_ctz(mask) : CHUNK_ABSENT;
+}
+
+__attribute__((target("sse4.1")))
+inline int scanChunkSSE41(const int64 *words, const int64 target){
+    const __m128i t = _mm_set1_epi64x(target);
+    __m128i tags = _mm_setzero_si128();
+    unsigned mask = 0;
+    for(int i = 0; i < CHUNK_KEYS; i += 2){
+        __m128i w = _mm_loadu_si128((const __m128i *)(words + i));
+        tags = _mm_or_si128(tags, w);
+        mask |= (unsigned)_mm_movemask_pd(_mm_castsi128_pd(_mm_cmpeq_epi64(w, t))) << i;
+    }
+    if(!_mm_testz_si128(tags, _mm_set1_epi64x(3))) return CHUNK_DESCRIPTOR;
+    return mask ? __builtin_ctz(mask) : CHUNK_ABSENT;
+}
+#endif
+
+template <class MCASType, class Key = int, class Value = int, class Compare = less<Key>>
+class SkipVectorMCASBased {
+private:
+    typedef KeyTraits<Key, Compare> KT;
+    typedef ValueCodec<Value> VC;
+    static_assert(is_integral<Key>::value && sizeof(Key) <= 4, "chunk keys are stored and compared as shifted 64-bit words");
+    static_assert(!VC::boxed, "values are copied between chunks as plain words, so they must be inline");
+    static const int64 MARK = 1;
+    struct Chunk{
+        Key fence;              //lower bound of the keys it covers
+        int height;
+        int64 version;
+        int64 keys[CHUNK_KEYS];     //key, or maxKey() when the slot is free
+        int64 values[CHUNK_KEYS];   //ValueCodec word of the key in the same slot
+        int64 succ[];           //height words, (successor | MARK)
+    };
+    typedef struct Chunk chunk;
+    //Logical contents of one chunk, read by an update
+    struct ChunkView{
+        int64 version, next;
+        int64 keys[CHUNK_KEYS], values[CHUNK_KEYS];
+        int count;
+    };
+
+    volatile char padding0[PADDING_BYTES];
+    const int numThreads;
+    volatile char padding1[PADDING_BYTES];
+    chunk *head, *tail;
+    Reclaimer *reclaimer;
+    MCASType *mcas;
+    int (*scanChunk)(const int64 *, const int64);
+    const char *scanName;
+    volatile char padding2[PADDING_BYTES];
+    atomic<int> topLevel;
+    volatile char padding3[PADDING_BYTES];
+    counter chunkEstimate;              //splits minus merges, for tower heights
+    RandomLevel rngs[MAX_THREADS];
+    volatile char padding4[PADDING_BYTES];
+
+    static int64 emptyKey() { return (int64)KT::maxKey(); }
+    static size_t chunkBytes(const int height) { return sizeof(chunk) + height*sizeof(int64); }
+    static chunk *ptrOf(int64 v) { return (chunk *)(uintptr_t)(v & ~MARK); }
+    static bool isMarked(int64 v) { return v & MARK; }
+    static void destroyChunk(const int tid, void *p);
+
+    chunk *allocChunk(const int tid, const Key & fence, const int height);
+    int randomLevel(const int tid);
+    void search(const int tid, const Key & key, chunk **preds, chunk **succs, const int levels);
+    chunk *findChunk(const int tid, const Key & key);
+    int findSlot(const int tid, chunk *c, const Key & key);
+    bool readView(const int tid, chunk *c, const Key & key, ChunkView & view);
+    bool split(const int tid, chunk *c, const ChunkView & view);
+    void merge(const int tid, chunk *c);
+
+public:
+    typedef Key KeyType;
+    typedef Value ValueType;
+
+    SkipVectorMCASBased(const int _numThreads);
+    ~SkipVectorMCASBased();
+
+    //Dictionary operations
+    Value contains(const int tid, const Key & key);
+    bool insertOrUpdate(const int tid, const Key & key, const Value & value);
+    bool erase(const int tid, const Key & key);
+
+    int valueTraversal();
+    void listTraversal();
+    long getSumOfKeys();
+    void printDebuggingDetails();
+};
+
+template <class MCASType, class Key, class Value, class Compare>
+SkipVectorMCASBased<MCASType, Key, Value, Compare>::SkipVectorMCASBased(const int _numThreads)
+        : numThreads(_numThreads) {
+    reclaimer = new Reclaimer(_numThreads);
+    mcas = new MCASType(reclaimer);
+    scanChunk = scanChunkScalar;
+    scanName = "scalar";
+#if (defined(__x86_64__) || defined(__i386__)) && !defined(CHUNK_SCAN_SCALAR)
+    if(__builtin_cpu_supports("avx2")){
+        scanChunk = scanChunkAVX2;
+        scanName = "avx2";
+    }else if(__builtin_cpu_supports("sse4.1")){
+        scanChunk = scanChunkSSE41;
+        scanName = "sse4.1";
+    }
+#endif
+    topLevel.store(1, MOR);
+    for(int tid = 0; tid < MAX_THREADS; tid++) rngs[tid].init((tid+1) * 0x9E3779B97F4A7C15ULL, 0.5, 1);
+    tail = allocChunk(0, KT::maxKey(), NR_LEVELS);
+    head = allocChunk(0, KT::minKey(), NR_LEVELS);
+    for(int l = 0; l < NR_LEVELS; l++){
+        mcas->valueWrite(&tail->succ[l], 0);
+        mcas->valueWrite(&head->succ[l], (int64)(uintptr_t)tail);
+    }
+}
+
+template <class MCASType, class Key, class Value, class Compare>
+SkipVectorMCASBased<MCASType, Key, Value, Compare>::~SkipVectorMCASBased() {
+    delete mcas;
+    delete reclaimer;
+    chunk *c = head;
+    while(c != NULL){
+        chunk *next = ptrOf(c->succ[0]>>2);
+        destroyChunk(0, c);
+        c = next;
+    }
+}
+
+//Values are inline, so a chunk owns nothing but its own bytes
+template <class MCASType, class Key, class Value, class Compare>
+void SkipVectorMCASBased<MCASType, Key, Value, Compare>::destroyChunk(const int tid, void *p){
+    chunk *c = (chunk *)p;
+    freeBytes(tid, c, chunkBytes(c->height));
+}
+
+template <class MCASType, class Key, class Value, class Compare>
+typename SkipVectorMCASBased<MCASType, Key, Value, Compare>::chunk * SkipVectorMCASBased<MCASType, Key, Value, Compare>::allocChunk(const int tid, const Key & fence, const int height){
+    chunk *c = (chunk *)allocBytes(tid, chunkBytes(height));
+    c->fence = fence;
+    c->height = height;
+    mcas->valueWrite(&c->version, 0);
+    for(int i = 0; i < CHUNK_KEYS; i++){
+        mcas->valueWrite(&c->keys[i], emptyKey());
+        mcas->valueWrite(&c->values[i], 0);
+    }
+    return c;
+}
+
+template <class MCASType, class Key, class Value, class Compare>
+int SkipVectorMCASBased<MCASType, Key, Value, Compare>::randomLevel(const int tid){
+    RandomLevel & rng = rngs[tid];
+    if(rng.refreshDue(CHUNK_LEVEL_REFRESH)){
+        int cap = RandomLevel::heightForSize(chunkEstimate.getTotal(), 0.5, NR_LEVELS);
+        rng.setMaxHeight(cap);
+        topLevel.store(cap, MOR);
+    }
+    return rng.next();
+}
+
+//Fills preds/succs with the last chunk whose fence is below key and the first one whose fence is
+//at or above key on the bottom levels levels
+template <class MCASType, class Key, class Value, class Compare>
+void SkipVectorMCASBased<MCASType, Key, Value, Compare>::search(const int tid, const Key & key, chunk **preds, chunk **succs, const int levels){
+    chunk *pred = head;
+    STAT_ADD(tid, LEVELS_TRAVERSED, levels);
+    for(int l = levels-1; l >= 0; l--){
+        chunk *curr = ptrOf(mcas->valueRead(tid, &pred->succ[l]));
+        while(KT::less(curr->fence, key)){
+            STAT_INC(tid, NODES_TRAVERSED);
+            pred = curr;
+            curr = ptrOf(mcas->valueRead(tid, &pred->succ[l]));
+        }
+        preds[l] = pred;
+        succs[l] = curr;
+    }
+}
+
+//Last chunk on the bottom level whose fence is at most key, reading without helping
+template <class MCASType, class Key, class Value, class Compare>
+typename SkipVectorMCASBased<MCASType, Key, Value, Compare>::chunk * SkipVectorMCASBased<MCASType, Key, Value, Compare>::findChunk(const int tid, const Key & key){
+    chunk *pred = head;
+    for(int l = topLevel.load(MOR)-1; l >= 0; l--){
+        chunk *curr = ptrOf(mcas->valueReadNoHelp(tid, &pred->succ[l]));
+        STAT_INC(tid, LEVELS_TRAVERSED);
+        while(KT::lessEq(curr->fence, key)){
+            STAT_INC(tid, NODES_TRAVERSED);
+            pred = curr;
+            curr = ptrOf(mcas->valueReadNoHelp(tid, &pred->succ[l]));
+        }
+    }
+    return pred;
+}
+
+//Slot holding key, or CHUNK_ABSENT; words holding descriptors are resolved one at a time
+template <class MCASType, class Key, class Value, class Compare>
+int SkipVectorMCASBased<MCASType, Key, Value, Compare>::findSlot(const int tid, chunk *c, const Key & key){
+    int slot = scanChunk(c->keys, (int64)key<<2);
+    if(slot != CHUNK_DESCRIPTOR) return slot;
+    for(int i = 0; i < CHUNK_KEYS; i++){
+        if(mcas->valueReadNoHelp(tid, &c->keys[i]) == (int64)key) return i;
+    }
+    return CHUNK_ABSENT;
+}
+
+template <class MCASType, class Key, class Value, class Compare>
+Value SkipVectorMCASBased<MCASType, Key, Value, Compare>::contains(const int tid, const Key & key){
+    Guard guard(reclaimer, tid);
+    while(true){
+        chunk *c = findChunk(tid, key);
+        int64 version = mcas->valueReadNoHelp(tid, &c->version);
+        int64 next = mcas->valueReadNoHelp(tid, &c->succ[0]);
+        if(!isMarked(next) && KT::less(key, ptrOf(next)->fence)){
+            int slot = findSlot(tid, c, key);
+            int64 w = (slot == CHUNK_ABSENT) ? 0 : mcas->valueReadNoHelp(tid, &c->values[slot]);
+            if(mcas->valueReadNoHelp(tid, &c->version) == version){
+                return (slot == CHUNK_ABSENT) ? VC::absent() : VC::decode(w);
+            }
+        }
+        STAT_INC(tid, SEARCH_RESTARTS);
+    }
+}
+
+//Reads c for an update of key, false if c is unlinked or no longer covers key. The keys and
+//values need not be consistent with the version: every MCAS built from them checks the words it
+//relies on.
+template <class MCASType, class Key, class Value, class Compare>
+bool SkipVectorMCASBased<MCASType, Key, Value, Compare>::readView(const int tid, chunk *c, const Key & key, ChunkView & view){
+    view.version = mcas->valueRead(tid, &c->version);
+    view.next = mcas->valueRead(tid, &c->succ[0]);
+    if(isMarked(view.next) || !KT::less(key, ptrOf(view.next)->fence)) return false;
+    view.count = 0;
+    for(int i = 0; i < CHUNK_KEYS; i++){
+        view.keys[i] = mcas->valueRead(tid, &c->keys[i]);
+        view.values[i] = mcas->valueRead(tid, &c->values[i]);
+        if(view.keys[i] != emptyKey()) view.count++;
+    }
+    return true;
+}
+
+template <class MCASType, class Key, class Value, class Compare>
+bool SkipVectorMCASBased<MCASType, Key, Value, Compare>::insertOrUpdate(const int tid, const Key & key, const Value & value){
+    Guard guard(reclaimer, tid);
+    chunk *preds[NR_LEVELS], *succs[NR_LEVELS];
+    int64 *a[3];
+    int64 e[3], n[3];
+    int64 newValue = VC::encode(tid, value);
+    ChunkView view;
+    while(true){
+        search(tid, key, preds, succs, topLevel.load(MOR));
+        chunk *c = KT::equal(succs[0]->fence, key) ? succs[0] : preds[0];
+        if(!readView(tid, c, key, view)){
+            STAT_INC(tid, SEARCH_RESTARTS);
+            continue;
+        }
+        int slot = CHUNK_ABSENT, empty = CHUNK_ABSENT;
+        for(int i = 0; i < CHUNK_KEYS; i++){
+            if(view.keys[i] == (int64)key) slot = i;
+            else if(view.keys[i] == emptyKey() && empty == CHUNK_ABSENT) empty = i;
+        }
+        if(slot != CHUNK_ABSENT){
+            //Update: only while the key is still in this slot
+            a[0] = &c->keys[slot]; e[0] = key; n[0] = key;
+            a[1] = &c->values[slot]; e[1] = view.values[slot]; n[1] = newValue;
+            if(mcas->doMCAS(tid, a, e, n, 2)) return false;
+        }else if(empty != CHUNK_ABSENT){
+            //The version proves that no key, key included, was added to c since it was read
+            a[0] = &c->version; e[0] = view.version; n[0] = view.version+1;
+            a[1] = &c->keys[empty]; e[1] = emptyKey(); n[1] = key;
+            a[2] = &c->values[empty]; e[2] = view.values[empty]; n[2] = newValue;
+            if(mcas->doMCAS(tid, a, e, n, 3)) return true;
+        }else{
+            split(tid, c, view);
+        }
+        STAT_INC(tid, SEARCH_RESTARTS);
+    }
+}
+
+//Moves the upper half of a full chunk into a new chunk linked right after it on every level of
+//the new chunk. The moved value words are part of the MCAS, so a concurrent update is either
+//copied or fails.
+template <class MCASType, class Key, class Value, class Compare>
+bool SkipVectorMCASBased<MCASType, Key, Value, Compare>::split(const int tid, chunk *c, const ChunkView & view){
+    if(view.count < CHUNK_KEYS) return false;
+    int order[CHUNK_KEYS];
+    for(int i = 0; i < CHUNK_KEYS; i++) order[i] = i;
+    sort(order, order + CHUNK_KEYS, [&](const int x, const int y){ return KT::less((Key)view.keys[x], (Key)view.keys[y]); });
+    const int half = CHUNK_KEYS/2;
+    const Key fence = (Key)view.keys[order[half]];
+    int height = randomLevel(tid);
+    chunk *preds[NR_LEVELS], *succs[NR_LEVELS];
+    search(tid, fence, preds, succs, max(height, topLevel.load(MOR)));
+    if(preds[0] != c || succs[0] != ptrOf(view.next)) return false;
+
+    chunk *s = allocChunk(tid, fence, height);
+    int64 *a[1+2*CHUNK_KEYS+NR_LEVELS];
+    int64 e[1+2*CHUNK_KEYS+NR_LEVELS], n[1+2*CHUNK_KEYS+NR_LEVELS];
+    int N = 0;
+    a[N] = &c->version; e[N] = view.version; n[N] = view.version+1; N++;
+    for(int j = 0; j < CHUNK_KEYS-half; j++){
+        int i = order[half+j];
+        mcas->valueWrite(&s->keys[j], view.keys[i]);
+        mcas->valueWrite(&s->values[j], view.values[i]);
+        a[N] = &c->keys[i]; e[N] = view.keys[i]; n[N] = emptyKey(); N++;
+        a[N] = &c->values[i]; e[N] = view.values[i]; n[N] = view.values[i]; N++;
+    }
+    for(int l = 0; l < height; l++){
+        mcas->valueWrite(&s->succ[l], (int64)(uintptr_t)succs[l]);
+        a[N] = &preds[l]->succ[l]; e[N] = (int64)(uintptr_t)succs[l]; n[N] = (int64)(uintptr_t)s; N++;
+    }
+    if(mcas->doMCAS(tid, a, e, n, N)){
+        chunkEstimate.inc(tid);
+        return true;
+    }
+    destroyChunk(tid, s);
+    return false;
+}
+
+template <class MCASType, class Key, class Value, class Compare>
+bool SkipVectorMCASBased<MCASType, Key, Value, Compare>::erase(const int tid, const Key & key){
+    Guard guard(reclaimer, tid);
+    int64 *a[1];
+    int64 e[1], n[1];
+    while(true){
+        chunk *c = findChunk(tid, key);
+        int64 version = mcas->valueRead(tid, &c->version);
+        int64 next = mcas->valueRead(tid, &c->succ[0]);
+        if(!isMarked(next) && KT::less(key, ptrOf(next)->fence)){
+            int slot = findSlot(tid, c, key);
+            if(slot == CHUNK_ABSENT){
+                if(mcas->valueRead(tid, &c->version) == version) return false;
+            }else{
+                //A split or merge that moves the key clears this slot first
+                a[0] = &c->keys[slot]; e[0] = key; n[0] = emptyKey();
+                if(mcas->doMCAS(tid, a, e, n, 1)){
+                    if(c != head) merge(tid, c);
+                    return true;
+                }
+            }
+        }
+        STAT_INC(tid, SEARCH_RESTARTS);
+    }
+}
+
+//Folds c into its predecessor on the bottom level once c holds at most a quarter of CHUNK_KEYS
+//and both fit in half of a chunk (or c is empty), and unlinks c on every level. Best effort: a
+//failed MCAS leaves the chunks as they are.
+template <class MCASType, class Key, class Value, class Compare>
+void SkipVectorMCASBased<MCASType, Key, Value, Compare>::merge(const int tid, chunk *c){
+    ChunkView cv, pv;
+    if(!readView(tid, c, c->fence, cv) || cv.count > CHUNK_KEYS/4) return;
+    chunk *preds[NR_LEVELS], *succs[NR_LEVELS];
+    const int h = c->height;
+    search(tid, c->fence, preds, succs, max(h, topLevel.load(MOR)));
+    for(int l = 0; l < h; l++){
+        if(succs[l] != c) return;                   //not linked on every level yet
+    }
+    chunk *p = preds[0];
+    if(!readView(tid, p, p->fence, pv) || ptrOf(pv.next) != c) return;
+    if(cv.count > 0 && pv.count + cv.count > CHUNK_KEYS/2) return;
+
+    int64 *a[2+4*CHUNK_KEYS+2*NR_LEVELS];
+    int64 e[2+4*CHUNK_KEYS+2*NR_LEVELS], n[2+4*CHUNK_KEYS+2*NR_LEVELS];
+    int N = 0;
+    a[N] = &p->version; e[N] = pv.version; n[N] = pv.version+1; N++;
+    a[N] = &c->version; e[N] = cv.version; n[N] = cv.version+1; N++;
+    int j = 0;
+    for(int i = 0; i < CHUNK_KEYS; i++){
+        if(cv.keys[i] == emptyKey()) continue;
+        while(pv.keys[j] != emptyKey()) j++;
+        a[N] = &c->keys[i]; e[N] = cv.keys[i]; n[N] = emptyKey(); N++;
+        a[N] = &c->values[i]; e[N] = cv.values[i]; n[N] = cv.values[i]; N++;
+        a[N] = &p->keys[j]; e[N] = emptyKey(); n[N] = cv.keys[i]; N++;
+        a[N] = &p->values[j]; e[N] = pv.values[j]; n[N] = cv.values[i]; N++;
+        j++;
+    }
+    for(int l = 0; l < h; l++){
+        int64 next = (l == 0) ? cv.next : mcas->valueRead(tid, &c->succ[l]);
+        if(isMarked(next)) return;
+        a[N] = &preds[l]->succ[l]; e[N] = (int64)(uintptr_t)c; n[N] = next; N++;
+        a[N] = &c->succ[l]; e[N] = next; n[N] = next | MARK; N++;
+    }
+    if(mcas->doMCAS(tid, a, e, n, N)){
+        chunkEstimate.add(tid, -1);
+        reclaimer->retire(tid, c, destroyChunk);
+    }
+}
+
+template <class MCASType, class Key, class Value, class Compare>
+long SkipVectorMCASBased<MCASType, Key, Value, Compare>::getSumOfKeys() {
+    long sum = 0;
+    for(chunk *c = head; c != tail; c = ptrOf(c->succ[0]>>2)){
+        for(int i = 0; i < CHUNK_KEYS; i++){
+            if((c->keys[i]>>2) != emptyKey()) sum += KT::checksum((Key)(c->keys[i]>>2));
+        }
+    }
+    return sum;
+}
+
+template <class MCASType, class Key, class Value, class Compare>
+int SkipVectorMCASBased<MCASType, Key, Value, Compare>::valueTraversal(){
+    int count = 0;
+    for(chunk *c = head; c != tail; c = ptrOf(c->succ[0]>>2)){
+        for(int i = 0; i < CHUNK_KEYS; i++){
+            if((c->keys[i]>>2) != emptyKey()) count++;
+        }
+    }
+    return count;
+}
+
+template <class MCASType, class Key, class Value, class Compare>
+void SkipVectorMCASBased<MCASType, Key, Value, Compare>::listTraversal(){
+    printf("Traversing chunks from head: ");
+    for(chunk *c = head; c != NULL; c = ptrOf(c->succ[0]>>2)){
+        int count = 0;
+        for(int i = 0; i < CHUNK_KEYS; i++){
+            if((c->keys[i]>>2) != emptyKey()) count++;
+        }
+        printf("%ld(h=%d, keys=%d) ", KT::checksum(c->fence), c->height, count);
+    }
+    printf("\n");
+}
+
+template <class MCASType, class Key, class Value, class Compare>
+void SkipVectorMCASBased<MCASType, Key, Value, Compare>::printDebuggingDetails() {
+    int chunks = 0;
+    for(chunk *c = ptrOf(head->succ[0]>>2); c != tail; c = ptrOf(c->succ[0]>>2)) chunks++;
+    cout<<"chunkScan="<<scanName<<" chunkKeys="<<CHUNK_KEYS<<" chunks="<<chunks+1<<endl;
+    //listTraversal();
+}
@@ -0,0 +1,122 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+
+#include "defines.h"
+
+using namespace std;
+
+/*
+ * Multiversioned values for point-in-time reads, in the style of vCAS (Wei et al., PPoPP 2021).
+ * A value word points to the newest Version of the value; each Version links to the one it
+ * replaced. Versions are installed with ts PENDING and stamped with the global clock right after
+ * they become visible; every reader stamps a PENDING version before using it, so the stamp is the
+ * version's linearization point for snapshot and plain reads alike. openSnapshot takes the clock
+ * and advances it, and a snapshot s sees the newest version with ts <= s. An erase installs a
+ * TOMBSTONE version instead of removing the node, so older snapshots still find the key.
+ * Each open snapshot announces a clock value no larger than its own; oldestActive is a lower bound
+ * on every snapshot that is open or will be opened, so versions older than the newest one with
+ * ts <= oldestActive can be trimmed, and a tombstone with ts <= oldestActive can be unlinked.
+ * Versions installed by one multi-word update share a group stamp: the first stamp of any of them
+ * fixes the group's timestamp and the others copy it, so a snapshot sees all of them or none.
+ * The installer stamps every version of the group before it retires the group stamp.
+ */
+
+#define SNAPSHOT_PENDING UINT64_MAX
+#define SNAPSHOT_NONE UINT64_MAX
+
+struct Version {
+    static constexpr int64 TOMBSTONE = -1;
+    int64 value;                    //ValueCodec word, or TOMBSTONE
+    atomic<uint64_t> ts;
+    atomic<Version *> older;
+    atomic<uint64_t> *group;        //shared stamp of a multi-word update, NULL for a single one
+
+    Version(const int64 _value, Version *_older, const uint64_t _ts = SNAPSHOT_PENDING, atomic<uint64_t> *_group = NULL)
+            : value(_value), ts(_ts), older(_older), group(_group) {}
+    bool isTombstone() const { return value == TOMBSTONE; }
+};
+
+class SnapshotClock {
+private:
+    struct Announcement {
+        volatile char padding[PADDING_BYTES-sizeof(atomic<uint64_t>)];
+        atomic<uint64_t> ts;
+    };
+    volatile char padding0[PADDING_BYTES];
+    atomic<uint64_t> clock;
+    volatile char padding1[PADDING_BYTES];
+    atomic<int> numOpen;
+    const int numThreads;
+    volatile char padding2[PADDING_BYTES];
+    Announcement announced[MAX_THREADS];
+
+public:
+    SnapshotClock(const int _numThreads);
+
+    //At most one snapshot per thread is open at a time
+    uint64_t open(const int tid);
+    void close(const int tid);
+    void stamp(Version *v);
+    uint64_t oldestActive();
+    //Newest version at or below v visible to snapshot s, NULL if the key did not exist yet
+    Version *visibleAt(Version *v, const uint64_t s);
+    //Detaches and returns the versions below v that no snapshot can reach any more
+    Version *obsolete(Version *v);
+} __attribute__((aligned(PADDING_BYTES)));
+
+SnapshotClock::SnapshotClock(const int _numThreads) : numThreads(_numThreads) {
+    clock.store(1, MOR);
+    numOpen.store(0, MOR);
+    for(int tid = 0; tid < MAX_THREADS; tid++) announced[tid].ts.store(SNAPSHOT_NONE, MOR);
+}
+
+//The announcement precedes the increment, so a concurrent oldestActive either sees it or read
+//the clock before this snapshot's timestamp
+uint64_t SnapshotClock::open(const int tid){
+    numOpen.fetch_add(1);
+    announced[tid].ts.store(clock.load());
+    return clock.fetch_add(1);
+}
+
+void SnapshotClock::close(const int tid){
+    announced[tid].ts.store(SNAPSHOT_NONE, memory_order_release);
+    numOpen.fetch_sub(1, memory_order_release);
+}
+
+void SnapshotClock::stamp(Version *v){
+    if(v->ts.load(memory_order_acquire) != SNAPSHOT_PENDING) return;
+    uint64_t expected = SNAPSHOT_PENDING;
+    uint64_t now = clock.load();
+    if(v->group != NULL){
+        v->group->compare_exchange_strong(expected, now);
+        now = v->group->load();
+        expected = SNAPSHOT_PENDING;
+    }
+    v->ts.compare_exchange_strong(expected, now);
+}
+
+//Reads the clock first: a snapshot whose open is not yet visible takes a timestamp at least this
+uint64_t SnapshotClock::oldestActive(){
+    uint64_t result = clock.load();
+    if(numOpen.load() == 0) return result;
+    for(int tid = 0; tid < numThreads; tid++){
+        uint64_t a = announced[tid].ts.load();
+        if(a < result) result = a;
+    }
+    return result;
+}
+
+Version *SnapshotClock::visibleAt(Version *v, const uint64_t s){
+    while(v != NULL){
+        stamp(v);
+        if(v->ts.load(memory_order_acquire) <= s) return v;
+        v = v->older.load(memory_order_acquire);
+    }
+    return NULL;
+}
+
+Version *SnapshotClock::obsolete(Version *v){
+    v = visibleAt(v, oldestActive());
+    return (v == NULL) ? NULL : v->older.exchange(NULL);
+}
@@ -0,0 +1,92 @@
+#pragma once
+#include <iostream>
+
+#include "defines.h"
+
+using namespace std;
+
+/*
+ * Contention and helping counters, per thread and padded like counter in util.h.
+ * Built with -DUSE_STATS the STAT_* macros add to globalStats; otherwise they expand to
+ * nothing and the instrumented code is exactly what it was without them.
+ */
+
+enum StatEvent {
+    CAS_ATTEMPTS,           //single-word CASes on links, marks, flags and values
+    CAS_FAILURES,
+    MCAS_OPS,               //doMCAS calls
+    MCAS_FAILURES,
+    MCAS_HELPS,             //MCASHelp run on another thread's descriptor
+    CCAS_HELPS,             //CCAS/RDCSS descriptors helped
+    DESCRIPTOR_READS,       //MCASRead found a descriptor instead of a value
+    BACKLINK_WALKS,         //back_link steps taken after a failed CAS
+    SEARCH_RESTARTS,        //searches resumed or repeated because an update CAS/MCAS failed
+    LEVELS_TRAVERSED,
+    NODES_TRAVERSED,        //rightward steps during searches
+    ELIMINATIONS,           //operations completed through the elimination array
+    INDEX_HITS,             //contains answered by the hash index without a search
+    INDEX_OVERFLOWS,        //tower roots left out of the hash index because their probe run was full
+    RANGE_BLOCKING_SCANS,   //range queries that blocked updates on their range after failing to validate
+    HTM_COMMITS,            //HTMMCAS updates decided inside a hardware transaction
+    HTM_CONFLICT_ABORTS,
+    HTM_CAPACITY_ABORTS,
+    HTM_DESCRIPTOR_ABORTS,  //transactions that found a software MCAS/CCAS descriptor
+    HTM_OTHER_ABORTS,
+    HTM_FALLBACKS,          //HTMMCAS updates that gave up on the transaction and ran MCAS
+    NUM_STAT_EVENTS
+};
+
+#ifdef USE_STATS
+
+class Stats {
+private:
+    struct PaddedCounts {
+        volatile char padding[PADDING_BYTES];
+        long long counts[NUM_STAT_EVENTS];
+    };
+    PaddedCounts data[MAX_THREADS];
+public:
+    Stats() {
+        clear();
+    }
+    void add(const int tid, const StatEvent event, const long long val) {
+        data[tid].counts[event] += val;
+    }
+    long long getTotal(const StatEvent event) {
+        long long result = 0;
+        for (int tid=0;tid<MAX_THREADS;++tid) result += data[tid].counts[event];
+        return result;
+    }
+    void clear() {
+        for (int tid=0;tid<MAX_THREADS;++tid) {
+            for (int e=0;e<NUM_STAT_EVENTS;++e) data[tid].counts[e] = 0;
+        }
+    }
+    static const char * name(const int event) {
+        static const char * names[NUM_STAT_EVENTS] = {"casAttempts", "casFailures", "mcasOps", "mcasFailures",
+                "mcasHelps", "ccasHelps", "descriptorReads", "backLinkWalks", "searchRestarts",
+                "levelsTraversed", "nodesTraversed", "eliminations", "indexHits", "indexOverflows", "rangeBlockingScans",
+                "htmCommits", "htmConflictAborts", "htmCapacityAborts", "htmDescriptorAborts", "htmOtherAborts",
+                "htmFallbacks"};
+        return names[event];
+    }
+    /** prints each total and its average per operation **/
+    void print(const long long numOps) {
+        for (int e=0;e<NUM_STAT_EVENTS;++e) {
+            long long total = getTotal((StatEvent) e);
+            cout<<name(e)<<"="<<total<<" perOp="<<(numOps > 0 ? (double) total / numOps : 0)<<endl;
+        }
+    }
+} __attribute__((aligned(PADDING_BYTES)));
+
+inline Stats globalStats;
+
+#define STAT_ADD(tid, event, val) globalStats.add((tid), (event), (val))
+
+#else
+
+#define STAT_ADD(tid, event, val) ((void)0)
+
+#endif
+
+#define STAT_INC(tid, event) STAT_ADD(tid, event, 1)
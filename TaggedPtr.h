@@ -0,0 +1,53 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+
+using namespace std;
+
+/*
+ * Pointer with a flag bit and a mark bit taken from its alignment, held in one atomic word.
+ * In the Fomitchev-Ruppert list, FLAG on a node's succ means its successor is being deleted,
+ * and MARK means the node itself is logically deleted.
+ * Loads are acquire and successful CASes are acq_rel. This publishes a node's fields along
+ * with the link to it, without the full fence of a __sync builtin.
+ */
+
+template <class T>
+class TaggedPtr {
+public:
+    static const uintptr_t FLAG = 1;
+    static const uintptr_t MARK = 2;
+    uintptr_t bits;
+
+    TaggedPtr() : bits(0) {}
+    explicit TaggedPtr(const uintptr_t _bits) : bits(_bits) {}
+    TaggedPtr(T *p, const bool mark, const bool flag) : bits((uintptr_t)p | (mark ? MARK : 0) | (flag ? FLAG : 0)) {}
+
+    T *ptr() const {
+        static_assert(alignof(T) >= 4, "TaggedPtr needs two free low bits");
+        return (T *)(bits & ~(FLAG|MARK));
+    }
+    bool isFlagged() const { return bits & FLAG; }
+    bool isMarked() const { return bits & MARK; }
+    bool operator==(const TaggedPtr & o) const { return bits == o.bits; }
+    bool operator!=(const TaggedPtr & o) const { return bits != o.bits; }
+};
+
+template <class T>
+class AtomicTaggedPtr {
+private:
+    atomic<uintptr_t> word;
+public:
+    AtomicTaggedPtr() : word(0) {}
+
+    TaggedPtr<T> load(const memory_order mo = memory_order_acquire) const { return TaggedPtr<T>(word.load(mo)); }
+    void store(const TaggedPtr<T> v, const memory_order mo = memory_order_release) { word.store(v.bits, mo); }
+    //On failure expected is updated to the current value
+    bool compareExchange(TaggedPtr<T> & expected, const TaggedPtr<T> desired) {
+        return word.compare_exchange_strong(expected.bits, desired.bits, memory_order_acq_rel, memory_order_acquire);
+    }
+
+    T *ptr() const { return load().ptr(); }
+    bool isFlagged() const { return load().isFlagged(); }
+    bool isMarked() const { return load().isMarked(); }
+};
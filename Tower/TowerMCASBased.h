@@ -0,0 +1,948 @@
+#pragma once
+#include <algorithm>
+#include <cstdio>
+#include <thread>
+#include <vector>
+
+#include "../defines.h"
+#include "../util.h"
+#include "../Pool.h"
+#include "../Reclaimer.h"
+#include "../KeyTraits.h"
+#include "../Stats.h"
+#ifdef USE_ELIMINATION
+#include "../Elimination.h"
+#endif
+#ifdef USE_SNAPSHOTS
+#include "../Snapshot.h"
+#endif
+
+using namespace std;
+
+/*
+ * Skip list with one allocation per key: the key, the value and a tower of succ words, one per
+ * level, share a single 64-byte aligned block, so descending a level reads the same node instead
+ * of chasing a pointer to another one. All links of a node change in a single MCAS:
+ * insert swings the predecessors on every level of the new node at once, and erase marks every
+ * succ word of the victim while unlinking it on every level. A node is therefore either fully
+ * linked or fully unlinked, and a marked succ word means the node has been erased.
+ * MCASType is the engine (MCAS or ReuseMCAS); words hold values shifted left by two, so succ
+ * words store (successor | MARK) and the value word stores the ValueCodec encoding of the value.
+ * Keys must lie strictly between KeyTraits<Key, Compare>::minKey() and maxKey().
+ * Searches keep predecessors on every level for the MCAS, more than HP_SLOTS can cover, so this
+ * list relies on the default epoch-based reclaimer.
+ * Head and tail span NR_LEVELS, but searches start at topLevel, which follows the number of keys
+ * (RandomLevel::heightForSize of an insert/erase count). It is only a hint: every level is a
+ * complete list, so starting lower is still correct, and updates that need a taller node's
+ * predecessors search from that node's height instead.
+ * Built with -DUSE_SNAPSHOTS the value word points to a chain of Versions (Snapshot.h) and erase
+ * first installs a tombstone version. The node is unlinked, with the tombstone as part of the
+ * MCAS, only once no open snapshot predates the tombstone; otherwise the key is kept on a
+ * per-thread list and unlinked by a later erase or closeSnapshot of that thread.
+ * atomicMulti applies several operations on different keys with one MCAS over all the words
+ * they read or write, so its descriptor grows with the number of keys; both engines accept any N.
+ */
+
+#ifndef SNAPSHOT_SWEEP_MIN
+#define SNAPSHOT_SWEEP_MIN 64           //deferred unlinks per thread before they are retried
+#endif
+
+template <class MCASType, class Key = int, class Value = int, class Compare = less<Key>>
+class TowerMCASBased {
+private:
+    typedef KeyTraits<Key, Compare> KT;
+    typedef ValueCodec<Value> VC;
+    static const int64 MARK = 1;
+    struct Node{
+        int height;
+        Key key;
+        int64 value;
+        int64 succ[];           //height words, (successor | MARK)
+    };
+    typedef struct Node node;
+
+    volatile char padding0[PADDING_BYTES];
+    const int numThreads;
+    volatile char padding1[PADDING_BYTES];
+    node *head, *tail;
+    Reclaimer *reclaimer;
+    MCASType *mcas;
+    volatile char padding2[PADDING_BYTES];
+    atomic<int> topLevel;
+    volatile char padding4[PADDING_BYTES];
+    counter sizeEstimate;               //inserts minus erases
+    RandomLevel rngs[MAX_THREADS];
+    volatile char padding3[PADDING_BYTES];
+#ifdef USE_ELIMINATION
+    EliminationArray<Key, Value, Compare> elimination;
+    bool eliminationApply(const int tid, const int op, const Key & key, const Value & value);
+#endif
+#ifdef USE_SNAPSHOTS
+    struct DeferredUnlinks {
+        volatile char padding0[PADDING_BYTES];
+        vector<Key> keys;
+        size_t sweepAt;
+        volatile char padding1[PADDING_BYTES];
+    };
+    SnapshotClock snapshots;
+    DeferredUnlinks deferred[MAX_THREADS];
+
+    static Version *versionOf(int64 w) { return (Version *)(uintptr_t)w; }
+    static void destroyVersion(const int tid, void *p);
+    void trim(const int tid, Version *v);
+    bool eraseVersion(const int tid, const Key & key);
+    void sweepDeferred(const int tid);
+    void deferUnlink(const int tid, const Key & key);
+#endif
+
+    //State of one key of atomicMulti, read before and computed after its operations
+    struct MultiKey {
+        Key key;
+        int height = 0;             //of the node inserted for key, if one is
+        node *curr = NULL;          //node holding key when read, NULL if none
+        node *newNode = NULL;
+        int64 oldWord = 0, newWord = 0;     //value word of curr as read and as installed
+        bool wasPresent = false, present = false, written = false;
+        Value value{};
+    };
+    //Per-thread buffers of atomicMulti, cleared on each call so they only allocate while growing
+    struct MultiScratch {
+        volatile char padding0[PADDING_BYTES];
+        vector<MultiKey> keys;
+        vector<node *> preds, succs;
+        vector<int64 *> a, sorted;
+        vector<int64> e, n;
+        vector<pair<node *, bool>> oldSeq, newSeq;      //(node, erased) and (node, inserted)
+        volatile char padding1[PADDING_BYTES];
+    };
+    MultiScratch multiScratch[MAX_THREADS];
+    static bool unlinks(const MultiKey & k);
+    static int findMultiKey(vector<MultiKey> & keys, const Key & key);
+    bool linkMultiLevel(const int tid, MultiScratch & s, const int l);
+
+    static size_t nodeBytes(const int height) { return sizeof(node) + height*sizeof(int64); }
+    static node *ptrOf(int64 v) { return (node *)(uintptr_t)(v & ~MARK); }
+    static bool isMarked(int64 v) { return v & MARK; }
+    static void destroyNode(const int tid, void *p);
+    //Value word of a node: the ValueCodec encoding, or with snapshots its newest Version
+    static int64 makeValueWord(const int tid, const Value & value);
+    static bool isPresent(const int64 w);
+    static Value valueOf(const int64 w);
+    static void discardValueWord(const int tid, const int64 w);
+
+    node *allocNode(const int tid, const Key & key, const int height);
+    int randomLevel(const int tid);
+    void search(const int tid, const Key & key, node **preds, node **succs, const int levels);
+    bool lookup(const int tid, const Key & key, Value & value);
+    bool doInsertOrUpdate(const int tid, const Key & key, const Value & value);
+    bool doErase(const int tid, const Key & key);
+    bool unlinkKey(const int tid, const Key & key, bool & blocked);
+
+public:
+    typedef Key KeyType;
+    typedef Value ValueType;
+
+    TowerMCASBased(const int _numThreads);
+    ~TowerMCASBased();
+
+    //Dictionary operations
+    Value contains(const int tid, const Key & key);
+    bool insertOrUpdate(const int tid, const Key & key, const Value & value);
+    bool erase(const int tid, const Key & key);
+
+    //Operations for atomicMulti; MULTI_MOVE erases key and inserts its value at to if key is
+    //present and to is absent, MULTI_SWAP exchanges the values of two present keys
+    enum MultiOpType { MULTI_INSERT = 0, MULTI_ERASE = 1, MULTI_UPDATE = 2, MULTI_MOVE = 3, MULTI_SWAP = 4 };
+    struct MultiOp {
+        int type;
+        Key key;
+        Key to;                     //second key of MULTI_MOVE and MULTI_SWAP
+        Value value;                //for MULTI_INSERT and MULTI_UPDATE (update only if present)
+        bool result;                //what the operation would return on its own
+    };
+    //Runs ops in order as a single atomic step
+    void atomicMulti(const int tid, MultiOp *ops, const int numOps);
+
+    //Initial population of an empty list, before any concurrent operation
+    void bulkLoad(const Key *keys, const Value *values, const long long n);
+
+#ifdef USE_SNAPSHOTS
+    //Point-in-time reads: every read with the same handle sees the list as it was when the
+    //snapshot was opened, without blocking or retrying. One snapshot per thread at a time.
+    uint64_t openSnapshot(const int tid);
+    void closeSnapshot(const int tid);
+    Value snapshotContains(const int tid, const uint64_t snap, const Key & key);
+    //Appends the keys in [lo, hi] present in snap to out in key order and returns how many
+    int snapshotRange(const int tid, const uint64_t snap, const Key & lo, const Key & hi, vector<Key> & out);
+#endif
+
+    int valueTraversal();
+    void listTraversal();
+    long getSumOfKeys();
+    void printDebuggingDetails();
+};
+
+template <class MCASType, class Key, class Value, class Compare>
+TowerMCASBased<MCASType, Key, Value, Compare>::TowerMCASBased(const int _numThreads)
+        : numThreads(_numThreads)
+#ifdef USE_SNAPSHOTS
+        , snapshots(_numThreads)
+#endif
+        {
+#ifdef USE_SNAPSHOTS
+    for(int tid = 0; tid < MAX_THREADS; tid++) deferred[tid].sweepAt = SNAPSHOT_SWEEP_MIN;
+#endif
+    reclaimer = new Reclaimer(_numThreads);
+    mcas = new MCASType(reclaimer);
+    topLevel.store(1, MOR);
+    for(int tid = 0; tid < MAX_THREADS; tid++) rngs[tid].init((tid+1) * 0x9E3779B97F4A7C15ULL, 0.5, 1);
+    tail = allocNode(0, KT::maxKey(), NR_LEVELS);
+    head = allocNode(0, KT::minKey(), NR_LEVELS);
+    for(int l = 0; l < NR_LEVELS; l++){
+        mcas->valueWrite(&tail->succ[l], 0);
+        mcas->valueWrite(&head->succ[l], (int64)(uintptr_t)tail);
+    }
+}
+
+template <class MCASType, class Key, class Value, class Compare>
+TowerMCASBased<MCASType, Key, Value, Compare>::~TowerMCASBased() {
+    delete mcas;
+    delete reclaimer;
+    node *n = head;
+    while(n != NULL){
+        node *next = ptrOf(n->succ[0]>>2);
+        destroyNode(0, n);
+        n = next;
+    }
+}
+
+template <class MCASType, class Key, class Value, class Compare>
+void TowerMCASBased<MCASType, Key, Value, Compare>::destroyNode(const int tid, void *p){
+    node *n = (node *)p;
+    discardValueWord(tid, n->value>>2);
+    n->key.~Key();
+    freeBytes(tid, n, nodeBytes(n->height));
+}
+
+#ifdef USE_SNAPSHOTS
+template <class MCASType, class Key, class Value, class Compare>
+int64 TowerMCASBased<MCASType, Key, Value, Compare>::makeValueWord(const int tid, const Value & value){
+    return (int64)(uintptr_t)allocObject<Version>(tid, VC::encode(tid, value), (Version *)NULL);
+}
+
+template <class MCASType, class Key, class Value, class Compare>
+bool TowerMCASBased<MCASType, Key, Value, Compare>::isPresent(const int64 w){
+    return !versionOf(w)->isTombstone();
+}
+
+template <class MCASType, class Key, class Value, class Compare>
+Value TowerMCASBased<MCASType, Key, Value, Compare>::valueOf(const int64 w){
+    return VC::decode(versionOf(w)->value);
+}
+
+//The whole chain belongs to the node: it was never published, or the node is being destroyed
+template <class MCASType, class Key, class Value, class Compare>
+void TowerMCASBased<MCASType, Key, Value, Compare>::discardValueWord(const int tid, const int64 w){
+    Version *v = versionOf(w);
+    while(v != NULL){
+        Version *older = v->older.load(MOR);
+        destroyVersion(tid, v);
+        v = older;
+    }
+}
+
+template <class MCASType, class Key, class Value, class Compare>
+void TowerMCASBased<MCASType, Key, Value, Compare>::destroyVersion(const int tid, void *p){
+    Version *v = (Version *)p;
+    if(!v->isTombstone()) VC::discard(tid, v->value);
+    freeObject(tid, v);
+}
+
+//Concurrent trims of one chain may detach overlapping tails; each link is claimed by exchanging
+//it with NULL, so every version is retired once
+template <class MCASType, class Key, class Value, class Compare>
+void TowerMCASBased<MCASType, Key, Value, Compare>::trim(const int tid, Version *v){
+    Version *rest = snapshots.obsolete(v);
+    while(rest != NULL){
+        Version *older = rest->older.exchange(NULL);
+        reclaimer->retire(tid, rest, destroyVersion);
+        rest = older;
+    }
+}
+#else
+template <class MCASType, class Key, class Value, class Compare>
+int64 TowerMCASBased<MCASType, Key, Value, Compare>::makeValueWord(const int tid, const Value & value){
+    return VC::encode(tid, value);
+}
+
+template <class MCASType, class Key, class Value, class Compare>
+bool TowerMCASBased<MCASType, Key, Value, Compare>::isPresent(const int64){
+    return true;
+}
+
+template <class MCASType, class Key, class Value, class Compare>
+Value TowerMCASBased<MCASType, Key, Value, Compare>::valueOf(const int64 w){
+    return VC::decode(w);
+}
+
+template <class MCASType, class Key, class Value, class Compare>
+void TowerMCASBased<MCASType, Key, Value, Compare>::discardValueWord(const int tid, const int64 w){
+    VC::discard(tid, w);
+}
+#endif
+
+template <class MCASType, class Key, class Value, class Compare>
+typename TowerMCASBased<MCASType, Key, Value, Compare>::node * TowerMCASBased<MCASType, Key, Value, Compare>::allocNode(const int tid, const Key & key, const int height){
+    node *n = (node *)allocBytes(tid, nodeBytes(height));
+    new (&n->key) Key(key);
+    n->height = height;
+    mcas->valueWrite(&n->value, 0);
+    return n;
+}
+
+template <class MCASType, class Key, class Value, class Compare>
+int TowerMCASBased<MCASType, Key, Value, Compare>::randomLevel(const int tid){
+    RandomLevel & rng = rngs[tid];
+    if(rng.refreshDue(LEVEL_REFRESH_INSERTS)){
+        int cap = RandomLevel::heightForSize(sizeEstimate.getTotal(), 0.5, NR_LEVELS);
+        rng.setMaxHeight(cap);
+        topLevel.store(cap, MOR);
+    }
+    return rng.next();
+}
+
+//Fills preds/succs with the last node before key and the first node at or after key on the
+//bottom levels levels
+template <class MCASType, class Key, class Value, class Compare>
+void TowerMCASBased<MCASType, Key, Value, Compare>::search(const int tid, const Key & key, node **preds, node **succs, const int levels){
+    node *pred = head;
+    STAT_ADD(tid, LEVELS_TRAVERSED, levels);
+    for(int l = levels-1; l >= 0; l--){
+        node *curr = ptrOf(mcas->valueRead(tid, &pred->succ[l]));
+        while(KT::less(curr->key, key)){
+            STAT_INC(tid, NODES_TRAVERSED);
+            pred = curr;
+            curr = ptrOf(mcas->valueRead(tid, &pred->succ[l]));
+        }
+        preds[l] = pred;
+        succs[l] = curr;
+    }
+}
+
+template <class MCASType, class Key, class Value, class Compare>
+Value TowerMCASBased<MCASType, Key, Value, Compare>::contains(const int tid, const Key & key){
+    Guard guard(reclaimer, tid);
+    Value value;
+    return lookup(tid, key, value) ? value : VC::absent();
+}
+
+//The value is read before checking the node is unmarked; since erase is final, the node held
+//that value while still linked. Every word is read through valueReadNoHelp, which resolves
+//descriptors to the logical value without helping, so a lookup writes nothing shared (except
+//for stamping a pending version with -DUSE_SNAPSHOTS).
+template <class MCASType, class Key, class Value, class Compare>
+bool TowerMCASBased<MCASType, Key, Value, Compare>::lookup(const int tid, const Key & key, Value & value){
+    node *pred = head, *curr = head;
+    for(int l = topLevel.load(MOR)-1; l >= 0; l--){
+        curr = ptrOf(mcas->valueReadNoHelp(tid, &pred->succ[l]));
+        STAT_INC(tid, LEVELS_TRAVERSED);
+        while(KT::less(curr->key, key)){
+            STAT_INC(tid, NODES_TRAVERSED);
+            pred = curr;
+            curr = ptrOf(mcas->valueReadNoHelp(tid, &pred->succ[l]));
+        }
+        if(KT::equal(curr->key, key)) break;
+    }
+    if(!KT::equal(curr->key, key)) return false;
+    int64 w = mcas->valueReadNoHelp(tid, &curr->value);
+#ifdef USE_SNAPSHOTS
+    snapshots.stamp(versionOf(w));
+#endif
+    if(!isPresent(w)) return false;
+    value = valueOf(w);
+    return !isMarked(mcas->valueReadNoHelp(tid, &curr->succ[0]));
+}
+
+template <class MCASType, class Key, class Value, class Compare>
+bool TowerMCASBased<MCASType, Key, Value, Compare>::insertOrUpdate(const int tid, const Key & key, const Value & value){
+#ifdef USE_ELIMINATION
+    bool result;
+    if(elimination.exchange(tid, ELIM_INSERT, key, value, result,
+            [&](const int op, const Value & v){ return eliminationApply(tid, op, key, v); })) return result;
+#endif
+    return doInsertOrUpdate(tid, key, value);
+}
+
+template <class MCASType, class Key, class Value, class Compare>
+bool TowerMCASBased<MCASType, Key, Value, Compare>::erase(const int tid, const Key & key){
+#ifdef USE_ELIMINATION
+    bool result;
+    if(elimination.exchange(tid, ELIM_ERASE, key, Value(), result,
+            [&](const int op, const Value & v){ return eliminationApply(tid, op, key, v); })) return result;
+#endif
+    return doErase(tid, key);
+}
+
+#ifdef USE_ELIMINATION
+template <class MCASType, class Key, class Value, class Compare>
+bool TowerMCASBased<MCASType, Key, Value, Compare>::eliminationApply(const int tid, const int op, const Key & key, const Value & value){
+    if(op == ELIM_INSERT) return doInsertOrUpdate(tid, key, value);
+    if(op == ELIM_ERASE) return doErase(tid, key);
+    Guard guard(reclaimer, tid);
+    Value v;
+    return lookup(tid, key, v);
+}
+#endif
+
+template <class MCASType, class Key, class Value, class Compare>
+bool TowerMCASBased<MCASType, Key, Value, Compare>::doInsertOrUpdate(const int tid, const Key & key, const Value & value){
+    Guard guard(reclaimer, tid);
+    node *preds[NR_LEVELS], *succs[NR_LEVELS];
+    int64 *a[NR_LEVELS];
+    int64 e[NR_LEVELS], n[NR_LEVELS];
+    node *newNode = NULL;
+    int64 newValue = makeValueWord(tid, value);
+    int height = randomLevel(tid);
+    while(true){
+        search(tid, key, preds, succs, max(height, topLevel.load(MOR)));
+        if(KT::equal(succs[0]->key, key)){
+            //Update: the value changes only while the node is still unmarked
+            node *curr = succs[0];
+            int64 oldValue = mcas->valueRead(tid, &curr->value);
+            int64 next = mcas->valueRead(tid, &curr->succ[0]);
+            if(isMarked(next)){
+                STAT_INC(tid, SEARCH_RESTARTS);
+                continue;
+            }
+#ifdef USE_SNAPSHOTS
+            snapshots.stamp(versionOf(oldValue));
+            versionOf(newValue)->older.store(versionOf(oldValue), MOR);
+#endif
+            a[0] = &curr->succ[0]; e[0] = next; n[0] = next;
+            a[1] = &curr->value; e[1] = oldValue; n[1] = newValue;
+            if(mcas->doMCAS(tid, a, e, n, 2)){
+                if(newNode != NULL){
+                    mcas->valueWrite(&newNode->value, 0);
+                    destroyNode(tid, newNode);
+                }
+#ifdef USE_SNAPSHOTS
+                snapshots.stamp(versionOf(newValue));
+                trim(tid, versionOf(newValue));
+                if(isPresent(oldValue)) return false;
+                sizeEstimate.inc(tid);              //reinserted over a tombstone
+                return true;
+#else
+                VC::release(tid, reclaimer, oldValue);
+                return false;
+#endif
+            }
+            STAT_INC(tid, SEARCH_RESTARTS);
+            continue;
+        }
+        if(newNode == NULL){
+            newNode = allocNode(tid, key, height);
+            mcas->valueWrite(&newNode->value, newValue);
+        }
+#ifdef USE_SNAPSHOTS
+        versionOf(newValue)->older.store(NULL, MOR);
+#endif
+        int h = newNode->height;
+        for(int l = 0; l < h; l++){
+            mcas->valueWrite(&newNode->succ[l], (int64)(uintptr_t)succs[l]);
+            a[l] = &preds[l]->succ[l];
+            e[l] = (int64)(uintptr_t)succs[l];
+            n[l] = (int64)(uintptr_t)newNode;
+        }
+        if(mcas->doMCAS(tid, a, e, n, h)){
+#ifdef USE_SNAPSHOTS
+            snapshots.stamp(versionOf(newValue));
+#endif
+            sizeEstimate.inc(tid);
+            return true;
+        }
+        STAT_INC(tid, SEARCH_RESTARTS);
+    }
+}
+
+template <class MCASType, class Key, class Value, class Compare>
+bool TowerMCASBased<MCASType, Key, Value, Compare>::doErase(const int tid, const Key & key){
+    Guard guard(reclaimer, tid);
+    bool blocked = false;
+#ifdef USE_SNAPSHOTS
+    if(!eraseVersion(tid, key)) return false;
+    unlinkKey(tid, key, blocked);
+    if(blocked) deferUnlink(tid, key);
+    return true;
+#else
+    return unlinkKey(tid, key, blocked);
+#endif
+}
+
+//Unlinks key on every level with one MCAS and returns whether this call removed it. With
+//snapshots only a node whose newest version is a tombstone is unlinked, and blocked is set if
+//an open snapshot may still read that tombstone.
+template <class MCASType, class Key, class Value, class Compare>
+bool TowerMCASBased<MCASType, Key, Value, Compare>::unlinkKey(const int tid, const Key & key, bool & blocked){
+    node *preds[NR_LEVELS], *succs[NR_LEVELS];
+    int64 *a[2*NR_LEVELS+1];
+    int64 e[2*NR_LEVELS+1], n[2*NR_LEVELS+1];
+    int levels = topLevel.load(MOR);
+#ifndef USE_SNAPSHOTS
+    (void)blocked;                              //only a snapshot can block an unlink
+#endif
+    while(true){
+        search(tid, key, preds, succs, levels);
+        node *victim = succs[0];
+        if(!KT::equal(victim->key, key)) return false;
+        int h = victim->height, N = 0;
+        if(h > levels){                         //taller than the levels searched
+            levels = h;
+            continue;
+        }
+        bool retry = false;
+        for(int l = 0; l < h; l++){
+            int64 next = mcas->valueRead(tid, &victim->succ[l]);
+            if(isMarked(next)) return false;        //erased by someone else
+            if(succs[l] != victim){                 //search passed this level before victim was linked
+                retry = true;
+                break;
+            }
+            a[N] = &preds[l]->succ[l]; e[N] = (int64)(uintptr_t)victim; n[N] = next; N++;
+            a[N] = &victim->succ[l]; e[N] = next; n[N] = next | MARK; N++;
+        }
+#ifdef USE_SNAPSHOTS
+        if(!retry){
+            int64 w = mcas->valueRead(tid, &victim->value);
+            if(isPresent(w)) return false;          //reinserted
+            if(versionOf(w)->ts.load(memory_order_acquire) > snapshots.oldestActive()){
+                blocked = true;
+                return false;
+            }
+            a[N] = &victim->value; e[N] = w; n[N] = w; N++;
+        }
+#endif
+        if(!retry && mcas->doMCAS(tid, a, e, n, N)){
+            reclaimer->retire(tid, victim, destroyNode);
+#ifndef USE_SNAPSHOTS
+            sizeEstimate.add(tid, -1);
+#endif
+            return true;
+        }
+        STAT_INC(tid, SEARCH_RESTARTS);
+    }
+}
+
+//Keys are read with one search each. The MCAS then holds the value word of every node found, the
+//succ words around each level where nodes are inserted or erased, and on the bottom level the
+//link that proves each absent key absent, so it fails if anything read has changed since.
+template <class MCASType, class Key, class Value, class Compare>
+void TowerMCASBased<MCASType, Key, Value, Compare>::atomicMulti(const int tid, MultiOp *ops, const int numOps){
+    Guard guard(reclaimer, tid);
+    MultiScratch & s = multiScratch[tid];
+    vector<MultiKey> & keys = s.keys;
+    keys.clear();
+    for(int i = 0; i < numOps; i++){
+        keys.push_back(MultiKey{ops[i].key});
+        if(ops[i].type == MULTI_MOVE || ops[i].type == MULTI_SWAP) keys.push_back(MultiKey{ops[i].to});
+    }
+    sort(keys.begin(), keys.end(), [](const MultiKey & x, const MultiKey & y){ return KT::less(x.key, y.key); });
+    keys.erase(unique(keys.begin(), keys.end(), [](const MultiKey & x, const MultiKey & y){ return KT::equal(x.key, y.key); }), keys.end());
+    const int K = keys.size();
+    int levels = topLevel.load(MOR);
+    for(auto & k : keys){
+        k.height = randomLevel(tid);
+        levels = max(levels, k.height);
+    }
+    vector<node *> & preds = s.preds, & succs = s.succs;
+    preds.resize(K*NR_LEVELS);
+    succs.resize(K*NR_LEVELS);
+    vector<int64 *> & a = s.a;
+    vector<int64> & e = s.e, & n = s.n;
+#ifdef USE_SNAPSHOTS
+    atomic<uint64_t> *group = allocObject<atomic<uint64_t>>(tid, SNAPSHOT_PENDING);
+#endif
+    while(true){
+        bool retry = false;
+        for(int i = 0; i < K && !retry; i++){
+            MultiKey & k = keys[i];
+            search(tid, k.key, &preds[i*NR_LEVELS], &succs[i*NR_LEVELS], levels);
+            k.curr = KT::equal(succs[i*NR_LEVELS]->key, k.key) ? succs[i*NR_LEVELS] : NULL;
+            k.newNode = NULL;
+            k.wasPresent = k.written = false;
+            if(k.curr == NULL) continue;
+            if(k.curr->height > levels){        //taller than the levels searched
+                levels = k.curr->height;
+                retry = true;
+                break;
+            }
+            k.oldWord = mcas->valueRead(tid, &k.curr->value);
+#ifdef USE_SNAPSHOTS
+            snapshots.stamp(versionOf(k.oldWord));
+#endif
+            k.wasPresent = isPresent(k.oldWord);
+            if(k.wasPresent) k.value = valueOf(k.oldWord);
+        }
+        if(retry) continue;
+        for(auto & k : keys) k.present = k.wasPresent;
+        for(int i = 0; i < numOps; i++){
+            MultiOp & op = ops[i];
+            MultiKey & x = keys[findMultiKey(keys, op.key)];
+            if(op.type == MULTI_INSERT){
+                op.result = !x.present;
+                x.present = x.written = true;
+                x.value = op.value;
+            }else if(op.type == MULTI_ERASE){
+                op.result = x.present;
+                x.present = false;
+            }else if(op.type == MULTI_UPDATE){
+                op.result = x.present;
+                if(x.present){
+                    x.value = op.value;
+                    x.written = true;
+                }
+            }else{
+                MultiKey & y = keys[findMultiKey(keys, op.to)];
+                if(op.type == MULTI_MOVE){
+                    op.result = x.present && !y.present;
+                    if(op.result){
+                        y.value = x.value;
+                        y.present = y.written = true;
+                        x.present = false;
+                    }
+                }else{
+                    op.result = x.present && y.present;
+                    if(op.result){
+                        swap(x.value, y.value);
+                        x.written = y.written = true;
+                    }
+                }
+            }
+        }
+        a.clear(); e.clear(); n.clear();
+        for(auto & k : keys){
+            if(k.curr != NULL){
+                k.newWord = k.oldWord;
+#ifdef USE_SNAPSHOTS
+                if(k.present && k.written) k.newWord = (int64)(uintptr_t)allocObject<Version>(tid, VC::encode(tid, k.value), versionOf(k.oldWord), SNAPSHOT_PENDING, group);
+                else if(!k.present && k.wasPresent) k.newWord = (int64)(uintptr_t)allocObject<Version>(tid, Version::TOMBSTONE, versionOf(k.oldWord), SNAPSHOT_PENDING, group);
+#else
+                if(k.present && k.written) k.newWord = VC::encode(tid, k.value);
+#endif
+                a.push_back(&k.curr->value); e.push_back(k.oldWord); n.push_back(k.newWord);
+            }else if(k.present){
+                k.newNode = allocNode(tid, k.key, k.height);
+#ifdef USE_SNAPSHOTS
+                k.newWord = (int64)(uintptr_t)allocObject<Version>(tid, VC::encode(tid, k.value), (Version *)NULL, SNAPSHOT_PENDING, group);
+#else
+                k.newWord = makeValueWord(tid, k.value);
+#endif
+                mcas->valueWrite(&k.newNode->value, k.newWord);
+            }
+        }
+        for(int l = 0; l < levels && !retry; l++){
+            retry = !linkMultiLevel(tid, s, l);
+        }
+        if(!retry){
+            vector<int64 *> & sorted = s.sorted;
+            sorted.assign(a.begin(), a.end());
+            sort(sorted.begin(), sorted.end());
+            retry = adjacent_find(sorted.begin(), sorted.end()) != sorted.end();     //searches disagree
+        }
+        if(!retry && mcas->doMCAS(tid, a.data(), e.data(), n.data(), a.size())){
+#ifdef USE_SNAPSHOTS
+            for(auto & k : keys){
+                if(k.newNode != NULL || (k.curr != NULL && k.newWord != k.oldWord)) snapshots.stamp(versionOf(k.newWord));
+            }
+            reclaimer->retire(tid, group);
+#endif
+            for(auto & k : keys){
+                if(k.present != k.wasPresent) sizeEstimate.add(tid, k.present ? 1 : -1);
+#ifdef USE_SNAPSHOTS
+                if(k.curr == NULL || k.newWord == k.oldWord) continue;
+                trim(tid, versionOf(k.newWord));
+                if(k.present) continue;
+                bool blocked = false;
+                unlinkKey(tid, k.key, blocked);
+                if(blocked) deferUnlink(tid, k.key);
+#else
+                if(unlinks(k)) reclaimer->retire(tid, k.curr, destroyNode);
+                else if(k.curr != NULL && k.newWord != k.oldWord) VC::release(tid, reclaimer, k.oldWord);
+#endif
+            }
+            return;
+        }
+        for(auto & k : keys){
+            if(k.newNode != NULL) destroyNode(tid, k.newNode);
+#ifdef USE_SNAPSHOTS
+            else if(k.curr != NULL && k.newWord != k.oldWord) destroyVersion(tid, versionOf(k.newWord));
+#else
+            else if(k.curr != NULL && k.newWord != k.oldWord) VC::discard(tid, k.newWord);
+#endif
+        }
+        STAT_INC(tid, SEARCH_RESTARTS);
+    }
+}
+
+//With snapshots an erased key keeps its node, with a tombstone, until unlinkKey removes it
+template <class MCASType, class Key, class Value, class Compare>
+bool TowerMCASBased<MCASType, Key, Value, Compare>::unlinks(const MultiKey & k){
+#ifdef USE_SNAPSHOTS
+    return false;
+#else
+    return k.curr != NULL && !k.present;
+#endif
+}
+
+template <class MCASType, class Key, class Value, class Compare>
+int TowerMCASBased<MCASType, Key, Value, Compare>::findMultiKey(vector<MultiKey> & keys, const Key & key){
+    return lower_bound(keys.begin(), keys.end(), key, [](const MultiKey & x, const Key & k){ return KT::less(x.key, k); }) - keys.begin();
+}
+
+//Adds the succ words of level l to the MCAS. Every key takes part on the bottom level, which
+//proves kept nodes unmarked and absent keys absent; above it only nodes inserted or erased there
+//do. Keys with nothing between them on this level form one fragment pred -> old nodes -> next;
+//every old node's link is expected as read and becomes its successor in the fragment rebuilt
+//with erased nodes dropped and new nodes added. Returns false if the searches disagree.
+template <class MCASType, class Key, class Value, class Compare>
+bool TowerMCASBased<MCASType, Key, Value, Compare>::linkMultiLevel(const int tid, MultiScratch & s, const int l){
+    vector<MultiKey> & keys = s.keys;
+    vector<node *> & preds = s.preds, & succs = s.succs;
+    vector<int64 *> & a = s.a;
+    vector<int64> & e = s.e, & n = s.n;
+    vector<pair<node *, bool>> & oldSeq = s.oldSeq, & newSeq = s.newSeq;
+    oldSeq.clear();
+    newSeq.clear();
+    node *trailing = NULL;
+    auto emit = [&](){
+        for(size_t j = 0; j < oldSeq.size(); j++){
+            node *x = oldSeq[j].first;
+            node *b = (j+1 < oldSeq.size()) ? oldSeq[j+1].first : trailing;
+            int64 next = (int64)(uintptr_t)b;
+            if(!oldSeq[j].second){
+                size_t q = 0;
+                while(newSeq[q].first != x) q++;
+                next = (int64)(uintptr_t)((q+1 < newSeq.size()) ? newSeq[q+1].first : trailing);
+            }
+            a.push_back(&x->succ[l]); e.push_back((int64)(uintptr_t)b); n.push_back(oldSeq[j].second ? ((int64)(uintptr_t)b | MARK) : next);
+        }
+        for(size_t q = 0; q < newSeq.size(); q++){
+            if(newSeq[q].second) mcas->valueWrite(&newSeq[q].first->succ[l], (int64)(uintptr_t)((q+1 < newSeq.size()) ? newSeq[q+1].first : trailing));
+        }
+    };
+    for(size_t i = 0; i < keys.size(); i++){
+        MultiKey & k = keys[i];
+        node *oldAt = (k.curr != NULL && k.curr->height > l) ? k.curr : NULL;
+        node *newAt = (k.newNode != NULL && k.height > l) ? k.newNode : NULL;
+        if(l > 0 && newAt == NULL && (oldAt == NULL || !unlinks(k))) continue;      //unchanged above the bottom level
+        node *lead = preds[i*NR_LEVELS+l];
+        node *next = succs[i*NR_LEVELS+l];
+        if(oldAt != NULL){
+            if(next != oldAt) return false;     //search passed this level before curr was linked
+            int64 v = mcas->valueRead(tid, &oldAt->succ[l]);
+            if(isMarked(v)) return false;
+            next = ptrOf(v);
+        }
+        if(!oldSeq.empty() && lead == oldSeq.back().first){
+            if(trailing != (oldAt != NULL ? oldAt : next)) return false;
+        }else{
+            if(!oldSeq.empty()) emit();
+            oldSeq.assign(1, make_pair(lead, false));
+            newSeq.assign(1, make_pair(lead, false));
+        }
+        if(oldAt != NULL) oldSeq.push_back(make_pair(oldAt, unlinks(k)));
+        if(newAt != NULL) newSeq.push_back(make_pair(newAt, true));
+        else if(oldAt != NULL && !unlinks(k)) newSeq.push_back(make_pair(oldAt, false));
+        trailing = next;
+    }
+    if(!oldSeq.empty()) emit();
+    return true;
+}
+
+#ifdef USE_SNAPSHOTS
+//Logical erase: replaces the newest version with a tombstone while the node is unmarked
+template <class MCASType, class Key, class Value, class Compare>
+bool TowerMCASBased<MCASType, Key, Value, Compare>::eraseVersion(const int tid, const Key & key){
+    node *preds[NR_LEVELS], *succs[NR_LEVELS];
+    int64 *a[2];
+    int64 e[2], n[2];
+    Version *tomb = NULL;
+    while(true){
+        search(tid, key, preds, succs, topLevel.load(MOR));
+        node *curr = succs[0];
+        if(!KT::equal(curr->key, key)) break;
+        int64 oldValue = mcas->valueRead(tid, &curr->value);
+        int64 next = mcas->valueRead(tid, &curr->succ[0]);
+        if(isMarked(next)){
+            STAT_INC(tid, SEARCH_RESTARTS);
+            continue;
+        }
+        snapshots.stamp(versionOf(oldValue));
+        if(!isPresent(oldValue)) break;
+        if(tomb == NULL) tomb = allocObject<Version>(tid, Version::TOMBSTONE, (Version *)NULL);
+        tomb->older.store(versionOf(oldValue), MOR);
+        a[0] = &curr->succ[0]; e[0] = next; n[0] = next;
+        a[1] = &curr->value; e[1] = oldValue; n[1] = (int64)(uintptr_t)tomb;
+        if(mcas->doMCAS(tid, a, e, n, 2)){
+            snapshots.stamp(tomb);
+            trim(tid, tomb);
+            sizeEstimate.add(tid, -1);
+            return true;
+        }
+        STAT_INC(tid, SEARCH_RESTARTS);
+    }
+    if(tomb != NULL) freeObject(tid, tomb);
+    return false;
+}
+
+template <class MCASType, class Key, class Value, class Compare>
+void TowerMCASBased<MCASType, Key, Value, Compare>::deferUnlink(const int tid, const Key & key){
+    deferred[tid].keys.push_back(key);
+    if(deferred[tid].keys.size() >= deferred[tid].sweepAt) sweepDeferred(tid);
+}
+
+//Retries this thread's deferred unlinks; the threshold doubles with the keys still blocked so
+//a long snapshot costs amortized O(1) retries per erase
+template <class MCASType, class Key, class Value, class Compare>
+void TowerMCASBased<MCASType, Key, Value, Compare>::sweepDeferred(const int tid){
+    vector<Key> & keys = deferred[tid].keys;
+    size_t kept = 0;
+    for(size_t i = 0; i < keys.size(); i++){
+        bool blocked = false;
+        unlinkKey(tid, keys[i], blocked);
+        if(blocked) keys[kept++] = keys[i];
+    }
+    keys.resize(kept);
+    deferred[tid].sweepAt = max((size_t)SNAPSHOT_SWEEP_MIN, 2*kept);
+}
+
+template <class MCASType, class Key, class Value, class Compare>
+uint64_t TowerMCASBased<MCASType, Key, Value, Compare>::openSnapshot(const int tid){
+    return snapshots.open(tid);
+}
+
+template <class MCASType, class Key, class Value, class Compare>
+void TowerMCASBased<MCASType, Key, Value, Compare>::closeSnapshot(const int tid){
+    snapshots.close(tid);
+    if(deferred[tid].keys.empty()) return;
+    Guard guard(reclaimer, tid);
+    sweepDeferred(tid);
+}
+
+//A node that is unlinked or being unlinked holds a tombstone no open snapshot predates, so
+//reading its versions gives the same answer as not finding it
+template <class MCASType, class Key, class Value, class Compare>
+Value TowerMCASBased<MCASType, Key, Value, Compare>::snapshotContains(const int tid, const uint64_t snap, const Key & key){
+    Guard guard(reclaimer, tid);
+    node *pred = head, *curr = head;
+    for(int l = topLevel.load(MOR)-1; l >= 0; l--){
+        curr = ptrOf(mcas->valueRead(tid, &pred->succ[l]));
+        while(KT::less(curr->key, key)){
+            pred = curr;
+            curr = ptrOf(mcas->valueRead(tid, &pred->succ[l]));
+        }
+        if(KT::equal(curr->key, key)) break;
+    }
+    if(!KT::equal(curr->key, key)) return VC::absent();
+    Version *v = snapshots.visibleAt(versionOf(mcas->valueRead(tid, &curr->value)), snap);
+    return (v == NULL || v->isTombstone()) ? VC::absent() : VC::decode(v->value);
+}
+
+template <class MCASType, class Key, class Value, class Compare>
+int TowerMCASBased<MCASType, Key, Value, Compare>::snapshotRange(const int tid, const uint64_t snap, const Key & lo, const Key & hi, vector<Key> & out){
+    Guard guard(reclaimer, tid);
+    node *preds[NR_LEVELS], *succs[NR_LEVELS];
+    search(tid, lo, preds, succs, topLevel.load(MOR));
+    int count = 0;
+    for(node *curr = succs[0]; curr != tail && KT::lessEq(curr->key, hi); curr = ptrOf(mcas->valueRead(tid, &curr->succ[0]))){
+        Version *v = snapshots.visibleAt(versionOf(mcas->valueRead(tid, &curr->value)), snap);
+        if(v == NULL || v->isTombstone()) continue;
+        out.push_back(curr->key);
+        count++;
+    }
+    return count;
+}
+#endif
+
+//Keys must be strictly increasing. Each of numThreads threads allocates the nodes of one slice of
+//the keys in key order, so a slice is laid out contiguously, and links it on every level; the
+//slices are then stitched together level by level between head and tail.
+template <class MCASType, class Key, class Value, class Compare>
+void TowerMCASBased<MCASType, Key, Value, Compare>::bulkLoad(const Key *keys, const Value *values, const long long n){
+    const int cap = RandomLevel::heightForSize(n, 0.5, NR_LEVELS);
+    const int T = (int)max(1LL, min((long long)numThreads, n));
+    vector<node *> first(T*NR_LEVELS, NULL), last(T*NR_LEVELS, NULL);
+    thread *threads[MAX_THREADS];
+    for(int tid = 0; tid < T; tid++){
+        threads[tid] = new thread([&, tid](){
+            node **f = &first[tid*NR_LEVELS], **l = &last[tid*NR_LEVELS];
+            rngs[tid].setMaxHeight(cap);
+            for(long long i = n*tid/T; i < n*(tid+1)/T; i++){
+                node *x = allocNode(tid, keys[i], rngs[tid].next());
+#ifdef USE_SNAPSHOTS
+                mcas->valueWrite(&x->value, (int64)(uintptr_t)allocObject<Version>(tid, VC::encode(tid, values[i]), (Version *)NULL, (uint64_t)0));
+#else
+                mcas->valueWrite(&x->value, VC::encode(tid, values[i]));
+#endif
+                for(int lv = 0; lv < x->height; lv++){
+                    if(l[lv] == NULL) f[lv] = x;
+                    else mcas->valueWrite(&l[lv]->succ[lv], (int64)(uintptr_t)x);
+                    l[lv] = x;
+                }
+            }
+        });
+    }
+    for(int tid = 0; tid < T; tid++){
+        threads[tid]->join();
+        delete threads[tid];
+    }
+    for(int lv = 0; lv < NR_LEVELS; lv++){
+        node *prev = head;
+        for(int tid = 0; tid < T; tid++){
+            if(first[tid*NR_LEVELS+lv] == NULL) continue;
+            mcas->valueWrite(&prev->succ[lv], (int64)(uintptr_t)first[tid*NR_LEVELS+lv]);
+            prev = last[tid*NR_LEVELS+lv];
+        }
+        mcas->valueWrite(&prev->succ[lv], (int64)(uintptr_t)tail);
+    }
+    sizeEstimate.add(0, n);
+    topLevel.store(cap, MOR);
+    atomic_thread_fence(memory_order_seq_cst);
+}
+
+template <class MCASType, class Key, class Value, class Compare>
+long TowerMCASBased<MCASType, Key, Value, Compare>::getSumOfKeys() {
+    long sum = 0;
+    node *n = ptrOf(head->succ[0]>>2);
+    while(n != tail){
+        if(isPresent(n->value>>2)) sum += KT::checksum(n->key);
+        n = ptrOf(n->succ[0]>>2);
+    }
+    return sum;
+}
+
+template <class MCASType, class Key, class Value, class Compare>
+int TowerMCASBased<MCASType, Key, Value, Compare>::valueTraversal(){
+    int count = 0;
+    node *n = ptrOf(head->succ[0]>>2);
+    while(n != tail){
+        if(isPresent(n->value>>2)) count++;
+        n = ptrOf(n->succ[0]>>2);
+    }
+    return count;
+}
+
+template <class MCASType, class Key, class Value, class Compare>
+void TowerMCASBased<MCASType, Key, Value, Compare>::listTraversal(){
+    node *n = head;
+    printf("Traversing list from head: ");
+    while(n != NULL){
+        printf("%ld(h=%d) ", KT::checksum(n->key), n->height);
+        n = ptrOf(n->succ[0]>>2);
+    }
+    printf("\n");
+}
+
+template <class MCASType, class Key, class Value, class Compare>
+void TowerMCASBased<MCASType, Key, Value, Compare>::printDebuggingDetails() {
+    //listTraversal();
+}
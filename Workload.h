@@ -0,0 +1,160 @@
+#pragma once
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+
+#include "defines.h"
+#include "util.h"
+
+using namespace std;
+
+/*
+ * Key distributions for the measured phase of a trial. Keys for every distribution except
+ * SEQUENTIAL are drawn up front into a per-thread ring of WORKLOAD_BUFFER_KEYS entries, so
+ * nextKey is a load and an increment with no allocation, floating point or shared state.
+ *   UNIFORM           every key in [1, n] equally likely
+ *   ZIPFIAN           rank r has probability proportional to 1/r^theta (0 < theta < 1, YCSB
+ *                     style); ranks are scattered over the key range so hot keys are not adjacent
+ *   HOTSET            hotAccessPercent of accesses go to the first hotKeyPercent of the keys
+ *   SEQUENTIAL        each thread walks the key range in increasing order, interleaved with the
+ *                     other threads, wrapping around at n (monotonic inserts)
+ *   SHIFTING_HOTSPOT  HOTSET whose hot window moves by its own width every shiftMillis
+ */
+
+#ifndef WORKLOAD_BUFFER_KEYS
+#define WORKLOAD_BUFFER_KEYS (1<<16)        //power of two
+#endif
+
+enum KeyDistribution { UNIFORM = 0, ZIPFIAN = 1, HOTSET = 2, SEQUENTIAL = 3, SHIFTING_HOTSPOT = 4 };
+
+struct WorkloadConfig {
+    int distribution = UNIFORM;
+    double zipfTheta = 0.99;
+    double hotKeyPercent = 1;
+    double hotAccessPercent = 90;
+    int shiftMillis = 1000;
+};
+
+class Workload {
+private:
+    struct ThreadKeys {
+        volatile char padding0[PADDING_BYTES];
+        int *keys;
+        int next;
+        long long sequence;
+        long long shift;
+        volatile char padding1[PADDING_BYTES];
+    };
+    volatile char padding0[PADDING_BYTES];
+    const WorkloadConfig config;
+    const int keyRangeSize;
+    const int numThreads;
+    long long hotKeys;
+    volatile char padding1[PADDING_BYTES];
+    ThreadKeys threadKeys[MAX_THREADS];
+    volatile char padding2[PADDING_BYTES];
+
+    static double nextDouble(RandomNatural & rng) { return rng.nextNatural() / 4294967296.0; }
+    void fillZipfian(RandomNatural *rngs);
+    void fillHotSet(RandomNatural *rngs);
+
+public:
+    Workload(const WorkloadConfig & _config, const int _keyRangeSize, const int _numThreads);
+    ~Workload();
+
+    //Key in [1, keyRangeSize] for the next operation of tid
+    int nextKey(const int tid) {
+        ThreadKeys & tk = threadKeys[tid];
+        if(config.distribution == SEQUENTIAL){
+            return 1 + (int)((tk.sequence++ * numThreads + tid) % keyRangeSize);
+        }
+        int key = tk.keys[tk.next];
+        tk.next = (tk.next + 1) & (WORKLOAD_BUFFER_KEYS-1);
+        if(config.distribution == SHIFTING_HOTSPOT){
+            key = 1 + (int)((key - 1 + tk.shift) % keyRangeSize);
+        }
+        return key;
+    }
+    //Called by tid with the elapsed time of the trial whenever it checks the timer
+    void setElapsedMillis(const int tid, const long long millis) {
+        threadKeys[tid].shift = (millis / config.shiftMillis) * hotKeys % keyRangeSize;
+    }
+    static const char *name(const int distribution);
+};
+
+Workload::Workload(const WorkloadConfig & _config, const int _keyRangeSize, const int _numThreads)
+        : config(_config), keyRangeSize(_keyRangeSize), numThreads(_numThreads) {
+    hotKeys = max(1LL, (long long)(keyRangeSize * config.hotKeyPercent / 100));
+    RandomNatural rngs[MAX_THREADS];
+    for(int tid = 0; tid < MAX_THREADS; tid++){
+        threadKeys[tid].keys = NULL;
+        threadKeys[tid].next = 0;
+        threadKeys[tid].sequence = 0;
+        threadKeys[tid].shift = 0;
+        rngs[tid].setSeed((tid+1) * 2654435761u);
+    }
+    if(config.distribution == SEQUENTIAL) return;
+    for(int tid = 0; tid < numThreads; tid++) threadKeys[tid].keys = new int[WORKLOAD_BUFFER_KEYS];
+    if(config.distribution == ZIPFIAN){
+        fillZipfian(rngs);
+    }else if(config.distribution == HOTSET || config.distribution == SHIFTING_HOTSPOT){
+        fillHotSet(rngs);
+    }else{
+        for(int tid = 0; tid < numThreads; tid++){
+            for(int i = 0; i < WORKLOAD_BUFFER_KEYS; i++) threadKeys[tid].keys[i] = 1 + rngs[tid].nextNatural() % keyRangeSize;
+        }
+    }
+}
+
+Workload::~Workload(){
+    for(int tid = 0; tid < MAX_THREADS; tid++) delete[] threadKeys[tid].keys;
+}
+
+//Gray et al., "Quickly generating billion-record synthetic databases", as used by YCSB
+void Workload::fillZipfian(RandomNatural *rngs){
+    const double theta = config.zipfTheta;
+    if(theta <= 0 || theta >= 1){
+        printf("ERROR: zipf theta must be in (0, 1)\n");
+        exit(1);
+    }
+    const long long n = keyRangeSize;
+    double zetan = 0;
+    for(long long i = 1; i <= n; i++) zetan += 1 / pow((double)i, theta);
+    const double zeta2 = 1 + 1 / pow(2.0, theta);
+    const double alpha = 1 / (1 - theta);
+    const double eta = (1 - pow(2.0 / n, 1 - theta)) / (1 - zeta2 / zetan);
+    for(int tid = 0; tid < numThreads; tid++){
+        for(int i = 0; i < WORKLOAD_BUFFER_KEYS; i++){
+            double u = nextDouble(rngs[tid]);
+            double uz = u * zetan;
+            long long rank;
+            if(uz < 1) rank = 0;
+            else if(uz < zeta2) rank = 1;
+            else rank = min(n-1, (long long)(n * pow(eta*u - eta + 1, alpha)));
+            //2654435761 is a prime larger than any int key range, so this permutes [0, n)
+            threadKeys[tid].keys[i] = 1 + (int)((uint64_t)rank * 2654435761ULL % n);
+        }
+    }
+}
+
+void Workload::fillHotSet(RandomNatural *rngs){
+    for(int tid = 0; tid < numThreads; tid++){
+        for(int i = 0; i < WORKLOAD_BUFFER_KEYS; i++){
+            bool hot = nextDouble(rngs[tid]) * 100 < config.hotAccessPercent || hotKeys == keyRangeSize;
+            int key = hot ? 1 + rngs[tid].nextNatural() % hotKeys
+                          : 1 + hotKeys + rngs[tid].nextNatural() % (keyRangeSize - hotKeys);
+            threadKeys[tid].keys[i] = key;
+        }
+    }
+}
+
+const char *Workload::name(const int distribution){
+    switch(distribution){
+        case UNIFORM: return "uniform";
+        case ZIPFIAN: return "zipfian";
+        case HOTSET: return "hotset";
+        case SEQUENTIAL: return "sequential";
+        case SHIFTING_HOTSPOT: return "shifting-hotspot";
+    }
+    return "unknown";
+}
@@ -9,7 +9,7 @@
 #endif
 
 #ifndef NR_LEVELS
-#define NR_LEVELS 12
+#define NR_LEVELS 32        //upper bound only; the skip lists size their active levels to the key count
 #endif
 
 #ifndef int64
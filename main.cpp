@@ -2,6 +2,7 @@
 #include <thread>
 #include <cstdlib>
 #include <string>
+#include <vector>
 #include <cstring>
 #include <iostream>
 #include <atomic>
@@ -10,12 +11,59 @@
 
 #include "defines.h"
 #include "util.h"
+#include "Workload.h"
+#include "Stats.h"
+#include "Numa.h"
 
 #include "MCASBasedSkipList.h"
 #include "CASBasedSkipList.h"
+#include "MCAS.h"
+#include "ReuseMCAS.h"
+#include "HTMMCAS.h"
+#include "Tower/TowerMCASBased.h"
+#include "Mikhail/MikhailCASBased.h"
+#include "SkipVector/SkipVectorMCASBased.h"
 
 using namespace std;
 
+// Where benchmark threads run and allocate, set from -P and -M
+NumaPlacement numaPlacement;
+
+// Optional operations are only benchmarked on data structures that provide them
+template <class T, class = void> struct hasRangeQuery : false_type {};
+template <class T> struct hasRangeQuery<T, void_t<decltype(&T::rangeQuery)>> : true_type {};
+template <class T, class = void> struct hasDeleteMin : false_type {};
+template <class T> struct hasDeleteMin<T, void_t<decltype(&T::deleteMin)>> : true_type {};
+template <class T, class = void> struct hasBatch : false_type {};
+template <class T> struct hasBatch<T, void_t<decltype(&T::insertBatch), decltype(&T::eraseBatch)>> : true_type {};
+template <class T, class = void> struct hasBulkLoad : false_type {};
+template <class T> struct hasBulkLoad<T, void_t<decltype(&T::bulkLoad)>> : true_type {};
+template <class T, class = void> struct hasSnapshots : false_type {};
+template <class T> struct hasSnapshots<T, void_t<decltype(&T::openSnapshot), decltype(&T::snapshotContains)>> : true_type {};
+template <class T, class = void> struct keyTypeOf { typedef int type; };
+template <class T> struct keyTypeOf<T, void_t<typename T::KeyType>> { typedef typename T::KeyType type; };
+
+// Data structures that size internal tables up front take the key range as a third constructor
+// argument, after the thread count and the tower growth probability
+template <class T>
+T * newDataStructure(const int totalThreads, const int keyRangeSize) {
+    if constexpr (is_constructible<T, int, double, long long>::value) return new T(totalThreads, 0.5, keyRangeSize);
+    else return new T(totalThreads);
+}
+
+// Benchmark keys are drawn as ints in [1, s] and mapped into the key type under test
+template <class Key>
+Key makeKey(const int k) {
+    if constexpr (sizeof(Key) > 4) return ((Key) k << 32) | k;
+    else return (Key) k;
+}
+template <>
+FixedString<16> makeKey<FixedString<16>>(const int k) {
+    char buf[17];
+    snprintf(buf, sizeof(buf), "key%012d", k);
+    return FixedString<16>(buf);
+}
+
 template <class DataStructureType>
 struct globals_t {
     RandomNatural rngs[MAX_THREADS];
@@ -31,12 +79,22 @@ struct globals_t {
     atomic_int running;         
     volatile char padding6[PADDING_BYTES];
     DataStructureType * ds;
+    Workload * workload;        // NULL while prefilling, and for the default inline uniform keys
     counter numTotalOps;
     counter keyChecksum;
     counter sizeChecksum;
+    counter numRangeKeys;
+    histogram insertLatency;
+    histogram eraseLatency;
+    histogram containsLatency;
+    histogram rangeLatency;
+    histogram deleteMinLatency;
+    int sampleRate;             // time one in every sampleRate operations, 0 for none
     int millisToRun;
     int totalThreads;
     int keyRangeSize;
+    int rangeLength;
+    int snapshotReads;          // keys read by each contains, through one snapshot if the data structure has them
     volatile char padding7[PADDING_BYTES];
     size_t garbage; 
     volatile char padding8[PADDING_BYTES];
@@ -49,17 +107,24 @@ struct globals_t {
         start = false;
         running = 0;
         ds = _ds;
+        workload = NULL;
         millisToRun = _millisToRun;
         totalThreads = _totalThreads;
         keyRangeSize = _keyRangeSize;
+        rangeLength = 0;
+        snapshotReads = 0;
+        sampleRate = 0;
         garbage = -1;
     }
     ~globals_t() {
         delete ds;
+        delete workload;
     }
 } __attribute__((aligned(PADDING_BYTES)));
 
-void runTrial(auto g, const long millisToRun, double insertPercent, double deletePercent) {
+template <class DataStructureType>
+void runTrial(globals_t<DataStructureType> * g, const long millisToRun, double insertPercent, double deletePercent, double rangePercent, double deleteMinPercent = 0) {
+    typedef typename keyTypeOf<DataStructureType>::type Key;
     g->done = false;
     g->start = false;
     
@@ -67,8 +132,10 @@ void runTrial(auto g, const long millisToRun, double insertPercent, double delet
     thread * threads[MAX_THREADS]; 
     for (int tid=0;tid<g->totalThreads;++tid) {
         threads[tid] = new thread([&, tid]() {
+            numaPlacement.bindThread(tid);
             const int TIME_CHECKS = 500;
             size_t garbage = 0;
+            pair<Key, int> * rangeBuffer = (rangePercent > 0) ? new pair<Key, int>[g->rangeLength] : NULL;
             
             // BARRIER WAIT
             g->running.fetch_add(1);
@@ -76,39 +143,85 @@ void runTrial(auto g, const long millisToRun, double insertPercent, double delet
             
             int key = 0;                
             int value = 0;
+            int sampleCountdown = g->sampleRate;
             for (int cnt=0; !g->done; ++cnt) {
-                if ((cnt % TIME_CHECKS) == 0 && g->timer.getElapsedMillis() >= millisToRun)                  
-                    g->done = true;
+                if ((cnt % TIME_CHECKS) == 0) {
+                    auto elapsed = g->timer.getElapsedMillis();
+                    if (elapsed >= millisToRun) g->done = true;
+                    if (g->workload != NULL) g->workload->setElapsedMillis(tid, elapsed);
+                }
                 
                 double operationType = g->rngs[tid].nextNatural() / (double) numeric_limits<unsigned int>::max() * 100;
                 
-                key = (int) (1 + (g->rngs[tid].nextNatural() % g->keyRangeSize));
+                key = (g->workload != NULL) ? g->workload->nextKey(tid) : (int) (1 + (g->rngs[tid].nextNatural() % g->keyRangeSize));
                 value = (int) g->rngs[tid].nextNatural()% 10000000;
+                Key k = makeKey<Key>(key);
+                bool sample = (sampleCountdown > 0 && --sampleCountdown == 0);
+                uint64_t startTicks = 0;
+                if (sample) {
+                    sampleCountdown = g->sampleRate;
+                    startTicks = readTSC();
+                }
 
                 // insert or delete this key (50% probability of each)
                 if (operationType < insertPercent) {
                     value = value < 0? -value:value;
-                    auto result = g->ds->insertOrUpdate(key, value);
+                    auto result = g->ds->insertOrUpdate(tid, k, value);
+                    if (sample) g->insertLatency.add(tid, readTSC() - startTicks);
                     //Checksum only updated the first time the key is inserted. Not added for update operation.
                     if (result) {
-                        g->keyChecksum.add(tid, key);
+                        g->keyChecksum.add(tid, KeyTraits<Key>::checksum(k));
                         g->sizeChecksum.add(tid, 1);
                         
                     }
                 } else if (operationType < insertPercent + deletePercent) {
-                    auto result = g->ds->erase(key);
+                    auto result = g->ds->erase(tid, k);
+                    if (sample) g->eraseLatency.add(tid, readTSC() - startTicks);
                     if (result) {
-                        g->keyChecksum.add(tid, -key);
+                        g->keyChecksum.add(tid, -KeyTraits<Key>::checksum(k));
                         g->sizeChecksum.add(tid, -1);
                     }
+                } else if (operationType < insertPercent + deletePercent + rangePercent) {
+                    if constexpr (hasRangeQuery<DataStructureType>::value) {
+                        auto result = g->ds->rangeQuery(tid, k, makeKey<Key>(key + g->rangeLength - 1), rangeBuffer);
+                        if (sample) g->rangeLatency.add(tid, readTSC() - startTicks);
+                        g->numRangeKeys.add(tid, result);
+                        garbage += result;
+                    }
+                } else if (operationType < insertPercent + deletePercent + rangePercent + deleteMinPercent) {
+                    if constexpr (hasDeleteMin<DataStructureType>::value) {
+                        typename DataStructureType::ValueType minValue;
+                        auto result = g->ds->deleteMin(tid, k, minValue);
+                        if (sample) g->deleteMinLatency.add(tid, readTSC() - startTicks);
+                        if (result) {
+                            g->keyChecksum.add(tid, -KeyTraits<Key>::checksum(k));
+                            g->sizeChecksum.add(tid, -1);
+                        }
+                    }
+                } else if (g->snapshotReads > 0) {
+                    // snapshotReads consecutive keys from one point in time, or as independent contains
+                    if constexpr (hasSnapshots<DataStructureType>::value) {
+                        auto snap = g->ds->openSnapshot(tid);
+                        for (int j=0;j<g->snapshotReads;++j) {
+                            garbage += g->ds->snapshotContains(tid, snap, makeKey<Key>(1 + (key - 1 + j) % g->keyRangeSize));
+                        }
+                        g->ds->closeSnapshot(tid);
+                    } else {
+                        for (int j=0;j<g->snapshotReads;++j) {
+                            garbage += g->ds->contains(tid, makeKey<Key>(1 + (key - 1 + j) % g->keyRangeSize));
+                        }
+                    }
+                    if (sample) g->containsLatency.add(tid, readTSC() - startTicks);
                 } else {
-                    auto result = g->ds->contains(key);
+                    auto result = g->ds->contains(tid, k);
+                    if (sample) g->containsLatency.add(tid, readTSC() - startTicks);
                     garbage += result;
                 }
                 
                 g->numTotalOps.inc(tid);
             }
             
+            delete[] rangeBuffer;
             g->running.fetch_add(-1);
             __sync_fetch_and_add(&g->garbage, garbage);
         });
@@ -130,25 +243,114 @@ void runTrial(auto g, const long millisToRun, double insertPercent, double delet
     }
 }
 
+// Inserts a pseudorandom prefillPercent of [1, s] in one pass, so that very large key ranges do not
+// need many random prefilling rounds. Data structures with bulkLoad build themselves from the sorted
+// keys; otherwise each thread inserts one contiguous block of keys.
+template <class DataStructureType>
+void runBulkPrefill(globals_t<DataStructureType> * g, double prefillPercent) {
+    typedef typename keyTypeOf<DataStructureType>::type Key;
+    if constexpr (hasBulkLoad<DataStructureType>::value) {
+        typedef typename DataStructureType::ValueType Value;
+        vector<Key> keys;
+        vector<Value> values;
+        keys.reserve((size_t) (g->keyRangeSize * prefillPercent / 100 * 1.01));
+        values.reserve(keys.capacity());
+        long long checksum = 0;
+        for (long long key=1; key<=g->keyRangeSize; ++key) {
+            if (g->rngs[0].nextNatural() % 10000 >= prefillPercent * 100) continue;
+            keys.push_back(makeKey<Key>((int) key));
+            values.push_back((Value) (key % 10000000));
+            checksum += KeyTraits<Key>::checksum(keys.back());
+        }
+        g->ds->bulkLoad(keys.data(), values.data(), (long long) keys.size());
+        g->keyChecksum.add(0, checksum);
+        g->sizeChecksum.add(0, keys.size());
+        return;
+    }
+    thread * threads[MAX_THREADS];
+    for (int tid=0;tid<g->totalThreads;++tid) {
+        threads[tid] = new thread([&, tid]() {
+            numaPlacement.bindThread(tid);
+            long long lo = 1 + (long long) g->keyRangeSize * tid / g->totalThreads;
+            long long hi = (long long) g->keyRangeSize * (tid+1) / g->totalThreads;
+            for (long long key=lo; key<=hi; ++key) {
+                if (g->rngs[tid].nextNatural() % 10000 >= prefillPercent * 100) continue;
+                Key k = makeKey<Key>((int) key);
+                if (g->ds->insertOrUpdate(tid, k, (int) (key % 10000000))) {
+                    g->keyChecksum.add(tid, KeyTraits<Key>::checksum(k));
+                    g->sizeChecksum.add(tid, 1);
+                }
+            }
+        });
+    }
+    for (int tid=0;tid<g->totalThreads;++tid) {
+        threads[tid]->join();
+        delete threads[tid];
+    }
+}
+
+// Throughput of the threads on each NUMA node, to expose cross-socket traffic; needs pinning
+void printPerSocket(counter & ops, int totalThreads, int millisToRun) {
+    if (!numaPlacement.isPinned()) return;
+    for (int node=0;node<numaPlacement.getNumNodes();++node) {
+        long long nodeOps = 0;
+        int nodeThreads = 0;
+        for (int tid=0;tid<totalThreads;++tid) {
+            if (numaPlacement.nodeOf(tid) != node) continue;
+            nodeOps += ops.get(tid);
+            ++nodeThreads;
+        }
+        if (nodeThreads == 0) continue;
+        cout<<"socket"<<node<<"Throughput="<<(long long) (nodeOps * 1000. / millisToRun)<<" threads="<<nodeThreads<<" perThread="<<(long long) (nodeOps * 1000. / millisToRun / nodeThreads)<<endl;
+    }
+}
+
+void printLatency(const char * name, histogram & h) {
+    double ticksPerNs = getTicksPerNanosecond();
+    cout<<name<<"LatencyNs";
+    cout<<" p50="<<(long long) (h.getPercentile(50) / ticksPerNs);
+    cout<<" p90="<<(long long) (h.getPercentile(90) / ticksPerNs);
+    cout<<" p99="<<(long long) (h.getPercentile(99) / ticksPerNs);
+    cout<<" p99.9="<<(long long) (h.getPercentile(99.9) / ticksPerNs);
+    cout<<" max="<<(long long) (h.getMax() / ticksPerNs);
+    cout<<" samples="<<h.getTotalCount()<<endl;
+}
+
 template <class DataStructureType>
-void runExperiment(int keyRangeSize, int millisToRun, int totalThreads, double insertPercent, double deletePercent) {
+void runExperiment(int keyRangeSize, int millisToRun, int totalThreads, double insertPercent, double deletePercent, double rangePercent, int rangeLength, bool bulkPrefill = false, const WorkloadConfig * workloadConfig = NULL, int sampleRate = 0, double deleteMinPercent = 0, int snapshotReads = 0) {
+    if (rangePercent > 0 && !hasRangeQuery<DataStructureType>::value) {
+        cout<<"ERROR: this data structure does not support range queries"<<endl;
+        exit(1);
+    }
+    if (deleteMinPercent > 0 && !hasDeleteMin<DataStructureType>::value) {
+        cout<<"ERROR: this data structure does not support deleteMin"<<endl;
+        exit(1);
+    }
     // create globals struct that all threads will access (with padding to prevent false sharing on control logic meta data)
     int minKey = 0;
     int maxKey = keyRangeSize;
-    auto dataStructure = new DataStructureType(totalThreads);
+    auto dataStructure = newDataStructure<DataStructureType>(totalThreads, keyRangeSize);
     auto g = new globals_t<DataStructureType>(millisToRun, totalThreads, keyRangeSize, dataStructure);
+    g->rangeLength = rangeLength;
     
     // Prefill the data structure
 
     g->timerFromStart.startTimer();
-    if(keyRangeSize > 2){
+    if(bulkPrefill){
+        double totalUpdatePercent = insertPercent + deletePercent;
+        double prefillingInsertPercent = (totalUpdatePercent < 1) ? 50 : (insertPercent / totalUpdatePercent) * 100;
+        runBulkPrefill(g, prefillingInsertPercent);
+        cout<<"bulk prefilling completed to size "<<g->sizeChecksum.getTotal()<<" (expected "<<(long long) (keyRangeSize * prefillingInsertPercent / 100)<<") total elapsed time="<<(g->timerFromStart.getElapsedMillis()/1000.)<<"s"<<endl;
+        cout<<endl;
+    }
+    else if(keyRangeSize > 2){
         for (int attempts=0;;++attempts) {
             double totalUpdatePercent = insertPercent + deletePercent;
             double prefillingInsertPercent = (totalUpdatePercent < 1) ? 50 : (insertPercent / totalUpdatePercent) * 100;
             double prefillingDeletePercent = (totalUpdatePercent < 1) ? 50 : (deletePercent / totalUpdatePercent) * 100;
             auto expectedSize = keyRangeSize * prefillingInsertPercent / 100;
 
-            runTrial(g, 200, prefillingInsertPercent, prefillingDeletePercent);
+            runTrial(g, 200, prefillingInsertPercent, prefillingDeletePercent, 0);
 
             // measure and print elapsed time
             cout<<"prefilling round "<<attempts<<" ending size "<<g->sizeChecksum.getTotal()<<" total elapsed time="<<(g->timerFromStart.getElapsedMillis()/1000.)<<"s"<<endl;
@@ -168,11 +370,26 @@ void runExperiment(int keyRangeSize, int millisToRun, int totalThreads, double i
         cout<<"Prefilling skipped for small key range..."<<endl;
     }
     printf("prefill done\n");
+    if (workloadConfig != NULL) {
+        g->workload = new Workload(*workloadConfig, keyRangeSize, totalThreads);
+        cout<<"keyDistribution="<<Workload::name(workloadConfig->distribution)<<endl;
+    }
+    auto rssBefore = getResidentMemoryKB();
+    cout<<"resident memory before experiment="<<rssBefore<<"KB"<<endl;
     //Run Experiment
     
     cout<<"main thread: experiment starting..."<<endl;
-    runTrial(g, g->millisToRun, insertPercent, deletePercent);
+    if (sampleRate > 0) getTicksPerNanosecond();
+    g->sampleRate = sampleRate;
+    g->snapshotReads = snapshotReads;
+    if (snapshotReads > 0) cout<<"snapshotReadMode="<<(hasSnapshots<DataStructureType>::value ? "snapshot" : "independent")<<endl;
+#ifdef USE_STATS
+    globalStats.clear();
+#endif
+    runTrial(g, g->millisToRun, insertPercent, deletePercent, rangePercent, deleteMinPercent);
     cout<<"main thread: experiment finished..."<<endl;
+    auto rssAfter = getResidentMemoryKB();
+    cout<<"resident memory after experiment="<<rssAfter<<"KB (delta "<<(rssAfter - rssBefore)<<"KB)"<<endl;
     cout<<endl;
     
     //Check output
@@ -190,6 +407,20 @@ void runExperiment(int keyRangeSize, int millisToRun, int totalThreads, double i
 
     cout<<"completedOperations="<<numTotalOps<<endl;
     cout<<"throughput="<<(long long) (numTotalOps * 1000. / g->millisToRun)<<endl;
+    printPerSocket(g->numTotalOps, totalThreads, g->millisToRun);
+    if (rangePercent > 0) {
+        cout<<"rangeQueryKeysReturned="<<g->numRangeKeys.getTotal()<<endl;
+    }
+    if (sampleRate > 0) {
+        printLatency("insert", g->insertLatency);
+        printLatency("erase", g->eraseLatency);
+        printLatency("contains", g->containsLatency);
+        if (rangePercent > 0) printLatency("rangeQuery", g->rangeLatency);
+        if (deleteMinPercent > 0) printLatency("deleteMin", g->deleteMinLatency);
+    }
+#ifdef USE_STATS
+    globalStats.print(numTotalOps);
+#endif
     cout<<endl;
     
     if (threadsSumOfKeys != dsSumOfKeys) {
@@ -202,17 +433,448 @@ void runExperiment(int keyRangeSize, int millisToRun, int totalThreads, double i
     delete g;
 }
 
+// Measures per-key cost of sorted batches: even keys are prefilled, then each thread repeatedly
+// inserts and erases a sorted batch of nearby odd keys, so the size of the structure stays fixed
+template <class DataStructureType>
+void runBatchExperiment(int keyRangeSize, int millisToRun, int totalThreads) {
+    if constexpr (!hasBatch<DataStructureType>::value) {
+        cout<<"ERROR: this data structure does not support batched operations"<<endl;
+        exit(1);
+    } else {
+        const int MAX_BATCH = 4096;
+        const int batchSizes[] = {1, 16, 256, MAX_BATCH};
+        auto dataStructure = new DataStructureType(totalThreads);
+        auto g = new globals_t<DataStructureType>(millisToRun, totalThreads, keyRangeSize, dataStructure);
+        
+        pair<int, int> * prefill = new pair<int, int>[MAX_BATCH];
+        long long prefillSize = 0;
+        for (int key=2; key<=keyRangeSize; ) {
+            int m = 0;
+            for (; m<MAX_BATCH && key<=keyRangeSize; ++m, key+=2) prefill[m] = make_pair(key, key);
+            prefillSize += g->ds->insertBatch(0, prefill, m);
+        }
+        delete[] prefill;
+        cout<<"prefilled "<<prefillSize<<" even keys"<<endl;
+        cout<<endl;
+        
+        for (int batchSize : batchSizes) {
+            g->numTotalOps.clear();
+            g->sizeChecksum.clear();
+            g->done = false;
+            g->start = false;
+            
+            thread * threads[MAX_THREADS];
+            for (int tid=0;tid<g->totalThreads;++tid) {
+                threads[tid] = new thread([&, tid]() {
+                    numaPlacement.bindThread(tid);
+                    pair<int, int> * kvs = new pair<int, int>[batchSize];
+                    int * keys = new int[batchSize];
+                    
+                    // BARRIER WAIT
+                    g->running.fetch_add(1);
+                    while (!g->start) { TRACE TPRINT("waiting to start"<<endl); }
+                    
+                    while (!g->done) {
+                        if (g->timer.getElapsedMillis() >= millisToRun)
+                            g->done = true;
+                        int m = 0;
+                        int key = 1 + 2 * (int) (g->rngs[tid].nextNatural() % ((keyRangeSize+1) / 2));
+                        for (; m<batchSize && key<=keyRangeSize; ++m) {
+                            keys[m] = key;
+                            kvs[m] = make_pair(key, (int) (g->rngs[tid].nextNatural() % 10000000));
+                            key += 2 * (1 + g->rngs[tid].nextNatural() % 4);
+                        }
+                        auto inserted = g->ds->insertBatch(tid, kvs, m);
+                        auto erased = g->ds->eraseBatch(tid, keys, m);
+                        g->sizeChecksum.add(tid, inserted - erased);
+                        g->numTotalOps.add(tid, 2*m);
+                    }
+                    
+                    delete[] kvs;
+                    delete[] keys;
+                    g->running.fetch_add(-1);
+                });
+            }
+            while (g->running < g->totalThreads) { }
+            g->timer.startTimer();
+            __sync_synchronize();
+            g->start = true;
+            while (g->running > 0) { }
+            for (int tid=0;tid<g->totalThreads;++tid) {
+                threads[tid]->join();
+                delete threads[tid];
+            }
+            
+            auto keysProcessed = g->numTotalOps.getTotal();
+            cout<<"batchSize="<<batchSize<<" keysProcessed="<<keysProcessed
+                <<" keysPerSecond="<<(long long) (keysProcessed * 1000. / millisToRun)
+                <<" nsPerKey="<<(keysProcessed ? (double) millisToRun * 1e6 * totalThreads / keysProcessed : 0)<<endl;
+            prefillSize += g->sizeChecksum.getTotal();
+        }
+        cout<<endl;
+        
+        auto dsSize = g->ds->valueTraversal();
+        cout<<"Validation: size according to the data structure = "<<dsSize<<" and according to the threads = "<<prefillSize<<".";
+        cout<<((dsSize == prefillSize) ? " OK." : " FAILED.")<<endl;
+        if (dsSize != prefillSize) {
+            cout<<"ERROR: validation failed!"<<endl;
+            exit(0);
+        }
+        delete g;
+    }
+}
+
+// Array of words that k-word MCAS operations move units between; the sum of all words never changes
+template <class MCASType>
+struct MCASArray {
+    Reclaimer * reclaimer;
+    MCASType * mcas;
+    int64 * words;
+    int size;
+
+    MCASArray(int numThreads, int _size) : size(_size) {
+        reclaimer = new Reclaimer(numThreads);
+        mcas = new MCASType(reclaimer);
+        words = new int64[size];
+        for (int i=0;i<size;++i) mcas->valueWrite(&words[i], 0);
+    }
+    ~MCASArray() {
+        delete mcas;
+        delete reclaimer;
+        delete[] words;
+    }
+};
+
+template <class MCASType>
+void runMCASExperiment(int arraySize, int millisToRun, int totalThreads, int wordsPerOp) {
+    if (wordsPerOp < 1 || wordsPerOp > 2*NR_LEVELS+1 || wordsPerOp > arraySize) {
+        cout<<"ERROR: words per MCAS must be in [1, min(s, "<<(2*NR_LEVELS+1)<<")]"<<endl;
+        exit(1);
+    }
+    auto arr = new MCASArray<MCASType>(totalThreads, arraySize);
+    auto g = new globals_t<MCASArray<MCASType>>(millisToRun, totalThreads, arraySize, arr);
+    auto rssBefore = getResidentMemoryKB();
+    
+    cout<<"main thread: MCAS experiment starting..."<<endl;
+#ifdef USE_STATS
+    globalStats.clear();
+#endif
+    thread * threads[MAX_THREADS];
+    for (int tid=0;tid<g->totalThreads;++tid) {
+        threads[tid] = new thread([&, tid]() {
+            numaPlacement.bindThread(tid);
+            const int TIME_CHECKS = 500;
+            int64 * a[2*NR_LEVELS+1];
+            int64 e[2*NR_LEVELS+1], n[2*NR_LEVELS+1];
+            
+            // BARRIER WAIT
+            g->running.fetch_add(1);
+            while (!g->start) { TRACE TPRINT("waiting to start"<<endl); }
+            
+            for (int cnt=0; !g->done; ++cnt) {
+                if ((cnt % TIME_CHECKS) == 0 && g->timer.getElapsedMillis() >= millisToRun)
+                    g->done = true;
+                
+                // pick wordsPerOp distinct words
+                for (int i=0;i<wordsPerOp;++i) {
+                    int64 * w;
+                    bool duplicate;
+                    do {
+                        w = &arr->words[g->rngs[tid].nextNatural() % arraySize];
+                        duplicate = false;
+                        for (int j=0;j<i;++j) duplicate |= (a[j] == w);
+                    } while (duplicate);
+                    a[i] = w;
+                }
+                
+                Guard guard(arr->reclaimer, tid);
+                for (int i=0;i<wordsPerOp;++i) {
+                    e[i] = arr->mcas->valueRead(tid, a[i]);
+                    n[i] = e[i] + ((i == 0) ? -(wordsPerOp-1) : 1);
+                }
+                if (arr->mcas->doMCAS(tid, a, e, n, wordsPerOp)) g->sizeChecksum.inc(tid);
+                g->numTotalOps.inc(tid);
+            }
+            g->running.fetch_add(-1);
+        });
+    }
+    
+    while (g->running < g->totalThreads) {
+        TRACE cout<<"main thread: waiting for threads to START running="<<g->running<<endl;
+    }
+    g->timer.startTimer();
+    __sync_synchronize();
+    g->start = true;
+    while (g->running > 0) { }
+    for (int tid=0;tid<g->totalThreads;++tid) {
+        threads[tid]->join();
+        delete threads[tid];
+    }
+    cout<<"main thread: MCAS experiment finished..."<<endl;
+    auto rssAfter = getResidentMemoryKB();
+    cout<<"resident memory before experiment="<<rssBefore<<"KB after="<<rssAfter<<"KB (delta "<<(rssAfter - rssBefore)<<"KB)"<<endl;
+    cout<<endl;
+    
+    long long sum = 0;
+    for (int i=0;i<arraySize;++i) sum += arr->mcas->valueRead(0, &arr->words[i]);
+    cout<<"Validation: sum of all words = "<<sum<<" (expected 0)."<<((sum == 0) ? " OK." : " FAILED.")<<endl;
+    cout<<endl;
+    
+    auto numTotalOps = g->numTotalOps.getTotal();
+    cout<<"completedOperations="<<numTotalOps<<endl;
+    cout<<"successfulOperations="<<g->sizeChecksum.getTotal()<<endl;
+    cout<<"throughput="<<(long long) (numTotalOps * 1000. / g->millisToRun)<<endl;
+    cout<<"nsPerOp="<<(numTotalOps > 0 ? totalThreads * g->millisToRun * 1e6 / numTotalOps : 0)<<endl;      //per thread
+    printPerSocket(g->numTotalOps, totalThreads, g->millisToRun);
+#ifdef USE_STATS
+    globalStats.print(numTotalOps);
+#endif
+    cout<<endl;
+    
+    if (sum != 0) {
+        cout<<"ERROR: validation failed!"<<endl;
+        exit(0);
+    }
+    delete g;
+}
+
+// Single-threaded cost of choosing tower heights: a generator built and seeded from the clock on
+// every call (what MikhailCASBased::determineLevel used to do) against RandomLevel, followed by
+// the cost of inserting every key of [1, s] in random order into MikhailCASBased
+void runLevelExperiment(int keyRangeSize, double levelProbability) {
+    const int DRAWS = 1000000;
+    auto legacyLevel = [](double prob) {
+        mt19937_64 rng;
+        uint64_t timeSeed = chrono::high_resolution_clock::now().time_since_epoch().count();
+        seed_seq ss{uint32_t(timeSeed & 0xffffffff), uint32_t(timeSeed>>32)};
+        rng.seed(ss);
+        uniform_real_distribution<double> distribution(0.0,1.0);
+        int tH = 1;
+        double number = distribution(rng);
+        while (tH<NR_LEVELS) {
+            if (number<(1-prob)) break;
+            number = distribution(rng);
+            tH++;
+        }
+        return tH;
+    };
+    long long heightSum = 0;
+    auto start = chrono::steady_clock::now();
+    for (int i=0;i<DRAWS;++i) heightSum += legacyLevel(levelProbability);
+    double legacyNs = chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - start).count() / (double) DRAWS;
+    cout<<"seededMt19937NsPerHeight="<<legacyNs<<" meanHeight="<<(double) heightSum / DRAWS<<endl;
+    
+    RandomLevel levels;
+    levels.init(0x9E3779B97F4A7C15ULL, levelProbability, NR_LEVELS);
+    heightSum = 0;
+    start = chrono::steady_clock::now();
+    for (int i=0;i<DRAWS;++i) heightSum += levels.next();
+    double ns = chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - start).count() / (double) DRAWS;
+    cout<<"randomLevelNsPerHeight="<<ns<<" meanHeight="<<(double) heightSum / DRAWS<<endl;
+    
+    int * keys = new int[keyRangeSize];
+    RandomNatural rng(12345);
+    for (int i=0;i<keyRangeSize;++i) keys[i] = i+1;
+    for (int i=keyRangeSize-1;i>0;--i) swap(keys[i], keys[rng.nextNatural() % (i+1)]);
+    auto ds = new MikhailCASBased<>(1, levelProbability);
+    start = chrono::steady_clock::now();
+    for (int i=0;i<keyRangeSize;++i) ds->insertOrUpdate(0, keys[i], keys[i]);
+    double insertNs = chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - start).count() / (double) keyRangeSize;
+    cout<<"insertNsPerKey="<<insertNs<<" size="<<ds->valueTraversal()<<endl;
+    delete ds;
+    delete[] keys;
+}
+
+// deleteMin ("prefix", see MikhailCASBased::deleteMin for what it guarantees) against
+// sprayDeleteMin at 1, 2, 4, ... up to -n threads (at most 128). The list
+// starts with the even keys of [1, s] and every thread alternates inserting a random absent key with
+// a deleteMin, so the size stays about s/2; meanRemovedKey shows how far spraying strays from the
+// front of the queue.
+void runPriorityQueueExperiment(int keyRangeSize, int millisToRun, int totalThreads) {
+    const char * modes[] = {"prefix", "spray"};
+    for (int numThreads=1; numThreads<=min(totalThreads, 128); numThreads*=2) {
+        for (int spray=0; spray<2; ++spray) {
+            auto ds = new MikhailCASBased<>(numThreads);
+            vector<int> keys(keyRangeSize / 2);
+            for (size_t i=0;i<keys.size();++i) keys[i] = 2*(i+1);
+            ds->bulkLoad(keys.data(), keys.data(), keys.size());
+            counter numOps, sizeChecksum, removedKeys, removedKeySum;
+            sizeChecksum.add(0, keys.size());
+            atomic<bool> start(false), done(false);
+            atomic<int> running(0);
+            
+            thread * threads[MAX_THREADS];
+            for (int tid=0;tid<numThreads;++tid) {
+                threads[tid] = new thread([&, tid]() {
+                    numaPlacement.bindThread(tid);
+                    RandomNatural rng((tid+1) * 2654435761u);
+                    running.fetch_add(1);
+                    while (!start) { }
+                    while (!done) {
+                        int key;
+                        do {
+                            key = 1 + rng.nextNatural() % keyRangeSize;
+                        } while (!ds->insertOrUpdate(tid, key, key));
+                        sizeChecksum.add(tid, 1);
+                        int minKey, minValue;
+                        if (spray ? ds->sprayDeleteMin(tid, minKey, minValue) : ds->deleteMin(tid, minKey, minValue)) {
+                            sizeChecksum.add(tid, -1);
+                            removedKeys.inc(tid);
+                            removedKeySum.add(tid, minKey);
+                        }
+                        numOps.add(tid, 2);
+                    }
+                    running.fetch_add(-1);
+                });
+            }
+            while (running < numThreads) { }
+            ElapsedTimer timer;
+            timer.startTimer();
+            start = true;
+            this_thread::sleep_for(chrono::milliseconds(millisToRun));
+            done = true;
+            for (int tid=0;tid<numThreads;++tid) {
+                threads[tid]->join();
+                delete threads[tid];
+            }
+            auto elapsed = timer.getElapsedMillis();
+            long long size = ds->valueTraversal();
+            cout<<"mode="<<modes[spray]<<" threads="<<numThreads<<" throughput="<<(long long) (numOps.getTotal() * 1000. / elapsed);
+            cout<<" meanRemovedKey="<<(removedKeys.getTotal() > 0 ? (double) removedKeySum.getTotal() / removedKeys.getTotal() : 0);
+            cout<<" size="<<size<<endl;
+            delete ds;
+            if (size != sizeChecksum.getTotal()) {
+                cout<<"ERROR: validation failed! expected size "<<sizeChecksum.getTotal()<<endl;
+                exit(0);
+            }
+        }
+    }
+}
+
+// Atomic multi-key updates on the inline-tower list: half of the keys are prefilled with their own
+// value, then each thread moves a random key's entry to another random key, or swaps the values of
+// two random keys, each through one atomicMulti. Moves and swaps keep the number of keys and the sum
+// of the values, which are checked at the end.
+template <class MCASType>
+void runTransferExperiment(const char * engine, int keyRangeSize, int millisToRun, int totalThreads) {
+    typedef TowerMCASBased<MCASType> DataStructureType;
+    typedef typename DataStructureType::MultiOp MultiOp;
+    auto ds = new DataStructureType(totalThreads);
+    vector<int> keys(keyRangeSize / 2);
+    for (size_t i=0;i<keys.size();++i) keys[i] = 2*(i+1);
+    ds->bulkLoad(keys.data(), keys.data(), keys.size());
+    auto totals = [&](long long & size, long long & valueSum) {
+        size = 0;
+        valueSum = 0;
+        for (int key=1; key<=keyRangeSize; ++key) {
+            int value = ds->contains(0, key);
+            if (value == INT32_MIN) continue;
+            ++size;
+            valueSum += value;
+        }
+    };
+    long long sizeBefore, valueSumBefore;
+    totals(sizeBefore, valueSumBefore);
+    counter numOps, numMoved, numSwapped;
+    atomic<bool> start(false), done(false);
+    atomic<int> running(0);
+    
+    thread * threads[MAX_THREADS];
+    for (int tid=0;tid<totalThreads;++tid) {
+        threads[tid] = new thread([&, tid]() {
+            numaPlacement.bindThread(tid);
+            RandomNatural rng((tid+1) * 2654435761u);
+            running.fetch_add(1);
+            while (!start) { }
+            while (!done) {
+                MultiOp op;
+                op.type = (rng.nextNatural() & 1) ? DataStructureType::MULTI_MOVE : DataStructureType::MULTI_SWAP;
+                op.key = 1 + rng.nextNatural() % keyRangeSize;
+                op.to = 1 + rng.nextNatural() % keyRangeSize;
+                ds->atomicMulti(tid, &op, 1);
+                if (op.result) (op.type == DataStructureType::MULTI_MOVE ? numMoved : numSwapped).inc(tid);
+                numOps.inc(tid);
+            }
+            running.fetch_add(-1);
+        });
+    }
+    while (running < totalThreads) { }
+    ElapsedTimer timer;
+    timer.startTimer();
+    start = true;
+    this_thread::sleep_for(chrono::milliseconds(millisToRun));
+    done = true;
+    for (int tid=0;tid<totalThreads;++tid) {
+        threads[tid]->join();
+        delete threads[tid];
+    }
+    auto elapsed = timer.getElapsedMillis();
+    long long sizeAfter, valueSumAfter;
+    totals(sizeAfter, valueSumAfter);
+    cout<<"engine="<<engine<<" threads="<<totalThreads<<" throughput="<<(long long) (numOps.getTotal() * 1000. / elapsed);
+    cout<<" moves="<<numMoved.getTotal()<<" swaps="<<numSwapped.getTotal()<<" size="<<sizeAfter<<" valueSum="<<valueSumAfter<<endl;
+    delete ds;
+    if (sizeAfter != sizeBefore || valueSumAfter != valueSumBefore) {
+        cout<<"ERROR: validation failed! expected size "<<sizeBefore<<" and valueSum "<<valueSumBefore<<endl;
+        exit(0);
+    }
+}
+
+template <class MCASType>
+void runTowerExperiment(int keyType, int keyRangeSize, int millisToRun, int totalThreads, double insertPercent, double deletePercent, double rangePercent, int rangeLength, bool bulkPrefill, const WorkloadConfig * workloadConfig, int sampleRate, int snapshotReads) {
+    if (keyType == 0) {
+        runExperiment<TowerMCASBased<MCASType>>(keyRangeSize, millisToRun, totalThreads, insertPercent, deletePercent, rangePercent, rangeLength, bulkPrefill, workloadConfig, sampleRate, 0, snapshotReads);
+    } else if (keyType == 1) {
+        runExperiment<TowerMCASBased<MCASType, int64_t>>(keyRangeSize, millisToRun, totalThreads, insertPercent, deletePercent, rangePercent, rangeLength, bulkPrefill, workloadConfig, sampleRate, 0, snapshotReads);
+    } else if (keyType == 2) {
+        runExperiment<TowerMCASBased<MCASType, FixedString<16>>>(keyRangeSize, millisToRun, totalThreads, insertPercent, deletePercent, rangePercent, rangeLength, bulkPrefill, workloadConfig, sampleRate, 0, snapshotReads);
+    } else {
+        cout<<"Wrong key type"<<endl;
+        exit(0);
+    }
+}
+
 int main(int argc, char** argv) {
     if (argc == 1) {
         cout<<"USAGE: "<<argv[0]<<" [options]"<<endl;
         cout<<"Options:"<<endl;
         cout<<"    -t [int]     milliseconds to run"<<endl;
         cout<<"    -c [int]     CAS to be used for datastructure, 0 for CAS, 1 for MCAS"<<endl;
+        cout<<"                 2 and 3 benchmark the MCAS engines alone: 2 for MCAS, 3 for MCAS with reusable descriptors"<<endl;
+        cout<<"                 (-s is then the number of words and -i/-d are ignored)"<<endl;
+        cout<<"                 4 and 5 for the inline-tower skip list on MCAS and on MCAS with reusable descriptors"<<endl;
+        cout<<"                 6 for the Fomitchev-Ruppert skip list (Mikhail/MikhailCASBased.h)"<<endl;
+        cout<<"                 7 to time tower height generation and single-threaded inserts into that list (-s keys)"<<endl;
+        cout<<"                 8 to compare deleteMin and sprayDeleteMin on that list at 1, 2, 4, ... -n threads"<<endl;
+        cout<<"                 9 for atomic moves and swaps between random keys of the inline-tower list, on each MCAS engine"<<endl;
+        cout<<"                 10 for the skip vector with chunked nodes on MCAS (SkipVector/SkipVectorMCASBased.h)"<<endl;
+        cout<<"                 11 for the inline-tower skip list on MCAS tried as an RTM transaction first (HTMMCAS.h),"<<endl;
+        cout<<"                 12 to benchmark that engine alone as -c 2 does; both fall back to MCAS without RTM"<<endl;
+        cout<<"    -P [policy]  pin thread tid to a CPU: compact (fill one socket first), scatter (alternate sockets),"<<endl;
+        cout<<"                 or a CPU list such as 0-7,16 (used round robin); per-socket throughput is then reported"<<endl;
+        cout<<"    -M [policy]  memory policy of the benchmark threads: firsttouch (default), local or interleave"<<endl;
+        cout<<"    -p [double]  probability that a tower grows another level, for -c 7 (default 0.5)"<<endl;
+        cout<<"    -K [int]     key type for -c 4 and -c 5: 0 for int (default), 1 for 64-bit, 2 for 16-byte strings"<<endl;
+        cout<<"    -f           prefill in one parallel pass over the key range instead of random rounds (for -s 100000000 and up)"<<endl;
+        cout<<"    -k [int]     words per MCAS for -c 2 and -c 3 (default 2)"<<endl;
+        cout<<"    -b           measure per-key cost of sorted insertBatch/eraseBatch at batch sizes 1, 16, 256 and 4096"<<endl;
         cout<<"    -s [int]     size of the key range that random keys will be drawn from (i.e., range [1, s])"<<endl;
         cout<<"    -n [int]     number of threads that will perform inserts and deletes"<<endl;
         cout<<"    -i [double]  percent of operations that will be insert (example: 20)"<<endl;
         cout<<"    -d [double]  percent of operations that will be delete (example: 20)"<<endl;
-        cout<<"                 (100 - i - d)% of operations will be contains"<<endl;
+        cout<<"    -r [double]  percent of operations that will be range queries (example: 10)"<<endl;
+        cout<<"    -l [int]     number of consecutive keys covered by each range query (default 100)"<<endl;
+        cout<<"    -q [double]  percent of operations that will be deleteMin, for -c 6 (example: 30)"<<endl;
+        cout<<"                 (100 - i - d - r - q)% of operations will be contains"<<endl;
+        cout<<"    -m [int]     each contains reads m consecutive keys, through one snapshot for -c 4 and -c 5"<<endl;
+        cout<<"                 built with -DUSE_SNAPSHOTS, otherwise as m independent contains (default 0, one key)"<<endl;
+        cout<<"    -w [int]     key distribution of the measured phase (prefilling stays uniform):"<<endl;
+        cout<<"                 0 uniform, 1 zipfian, 2 hot set, 3 sequential, 4 shifting hotspot"<<endl;
+        cout<<"    -z [double]  zipfian theta, in (0, 1) (default 0.99)"<<endl;
+        cout<<"    -hk [double] percent of keys in the hot set (default 1)"<<endl;
+        cout<<"    -ha [double] percent of accesses that go to the hot set (default 90)"<<endl;
+        cout<<"    -hs [int]    milliseconds between hotspot shifts for -w 4 (default 1000)"<<endl;
+        cout<<"    -S [int]     time one in every S operations and print latency percentiles (default 0, off)"<<endl;
         cout<<endl;
         return 1;
     }
@@ -221,8 +883,20 @@ int main(int argc, char** argv) {
     int keyRangeSize = 0;
     int totalThreads = 0;
     int casType = 0;
+    int wordsPerOp = 2;
+    int keyType = 0;
+    bool batchMode = false;
+    bool bulkPrefill = false;
     double insertPercent = 0;
     double deletePercent = 0;
+    double rangePercent = 0;
+    double deleteMinPercent = 0;
+    int rangeLength = 100;
+    int snapshotReads = 0;
+    WorkloadConfig workloadConfig;
+    bool useWorkload = false;
+    int sampleRate = 0;
+    double levelProbability = 0.5;
     
     // read command line args
     for (int i=1;i<argc;++i) {
@@ -232,12 +906,53 @@ int main(int argc, char** argv) {
             totalThreads = atoi(argv[++i]);
         }else if (strcmp(argv[i], "-c") == 0) {
             casType = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-b") == 0) {
+            batchMode = true;
+        } else if (strcmp(argv[i], "-f") == 0) {
+            bulkPrefill = true;
+        } else if (strcmp(argv[i], "-K") == 0) {
+            keyType = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-k") == 0) {
+            wordsPerOp = atoi(argv[++i]);
         } else if (strcmp(argv[i], "-t") == 0) {
             millisToRun = atoi(argv[++i]);
         } else if (strcmp(argv[i], "-i") == 0) {
             insertPercent = atof(argv[++i]);
         } else if (strcmp(argv[i], "-d") == 0) {
             deletePercent = atof(argv[++i]);
+        } else if (strcmp(argv[i], "-r") == 0) {
+            rangePercent = atof(argv[++i]);
+        } else if (strcmp(argv[i], "-q") == 0) {
+            deleteMinPercent = atof(argv[++i]);
+        } else if (strcmp(argv[i], "-m") == 0) {
+            snapshotReads = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-l") == 0) {
+            rangeLength = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-w") == 0) {
+            workloadConfig.distribution = atoi(argv[++i]);
+            useWorkload = true;
+        } else if (strcmp(argv[i], "-z") == 0) {
+            workloadConfig.zipfTheta = atof(argv[++i]);
+        } else if (strcmp(argv[i], "-hk") == 0) {
+            workloadConfig.hotKeyPercent = atof(argv[++i]);
+        } else if (strcmp(argv[i], "-ha") == 0) {
+            workloadConfig.hotAccessPercent = atof(argv[++i]);
+        } else if (strcmp(argv[i], "-hs") == 0) {
+            workloadConfig.shiftMillis = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-S") == 0) {
+            sampleRate = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-P") == 0) {
+            if (!numaPlacement.setPinPolicy(argv[++i])) {
+                cout<<"bad pinning policy"<<endl;
+                exit(1);
+            }
+        } else if (strcmp(argv[i], "-M") == 0) {
+            if (!numaPlacement.setMemPolicy(argv[++i])) {
+                cout<<"bad memory policy"<<endl;
+                exit(1);
+            }
+        } else if (strcmp(argv[i], "-p") == 0) {
+            levelProbability = atof(argv[++i]);
         } else {
             cout<<"bad arguments"<<endl;
             exit(1);
@@ -257,17 +972,72 @@ int main(int argc, char** argv) {
     PRINT(keyRangeSize);
     PRINT(insertPercent);
     PRINT(deletePercent);
+    PRINT(rangePercent);
+    PRINT(rangeLength);
+    PRINT(deleteMinPercent);
+    PRINT(snapshotReads);
     PRINT(millisToRun);
+    PRINT(sampleRate);
+    PRINT(levelProbability);
+    numaPlacement.printConfig();
+    if (useWorkload) {
+        PRINT(workloadConfig.distribution);
+        PRINT(workloadConfig.zipfTheta);
+        PRINT(workloadConfig.hotKeyPercent);
+        PRINT(workloadConfig.hotAccessPercent);
+        PRINT(workloadConfig.shiftMillis);
+    }
     cout<<endl;
     // check for too large thread count
     if (totalThreads >= MAX_THREADS) {
         std::cout<<"ERROR: totalThreads="<<totalThreads<<" >= MAX_THREADS="<<MAX_THREADS<<std::endl;
         return 1;
     }
-    if(casType == 0){
-        runExperiment<CASBasedSkipList>(keyRangeSize, millisToRun, totalThreads, insertPercent, deletePercent);
+    if(batchMode){
+        if(casType == 0){
+            runBatchExperiment<CASBasedSkipList>(keyRangeSize, millisToRun, totalThreads);
+        }else if(casType == 1){
+            runBatchExperiment<MCASBasedSkipList>(keyRangeSize, millisToRun, totalThreads);
+        }else if(casType == 6){
+            runBatchExperiment<MikhailCASBased<>>(keyRangeSize, millisToRun, totalThreads);
+        }else{
+            std::cout <<"Batched operations are not available for this cas type"<<endl;
+            exit(0);
+        }
+    }else if(casType == 0){
+        runExperiment<CASBasedSkipList>(keyRangeSize, millisToRun, totalThreads, insertPercent, deletePercent, rangePercent, rangeLength, bulkPrefill, useWorkload ? &workloadConfig : NULL, sampleRate);
     }else if(casType == 1){
-        runExperiment<MCASBasedSkipList>(keyRangeSize, millisToRun, totalThreads, insertPercent, deletePercent);
+        runExperiment<MCASBasedSkipList>(keyRangeSize, millisToRun, totalThreads, insertPercent, deletePercent, rangePercent, rangeLength, bulkPrefill, useWorkload ? &workloadConfig : NULL, sampleRate);
+    }else if(casType == 2){
+        runMCASExperiment<MCAS>(keyRangeSize, millisToRun, totalThreads, wordsPerOp);
+    }else if(casType == 3){
+        runMCASExperiment<ReuseMCAS>(keyRangeSize, millisToRun, totalThreads, wordsPerOp);
+    }else if(casType == 4){
+        runTowerExperiment<MCAS>(keyType, keyRangeSize, millisToRun, totalThreads, insertPercent, deletePercent, rangePercent, rangeLength, bulkPrefill, useWorkload ? &workloadConfig : NULL, sampleRate, snapshotReads);
+    }else if(casType == 5){
+        runTowerExperiment<ReuseMCAS>(keyType, keyRangeSize, millisToRun, totalThreads, insertPercent, deletePercent, rangePercent, rangeLength, bulkPrefill, useWorkload ? &workloadConfig : NULL, sampleRate, snapshotReads);
+    }else if(casType == 6){
+        runExperiment<MikhailCASBased<>>(keyRangeSize, millisToRun, totalThreads, insertPercent, deletePercent, rangePercent, rangeLength, bulkPrefill, useWorkload ? &workloadConfig : NULL, sampleRate, deleteMinPercent);
+    }else if(casType == 7){
+        runLevelExperiment(keyRangeSize, levelProbability);
+    }else if(casType == 8){
+        runPriorityQueueExperiment(keyRangeSize, millisToRun, totalThreads);
+    }else if(casType == 9){
+        runTransferExperiment<MCAS>("mcas", keyRangeSize, millisToRun, totalThreads);
+        runTransferExperiment<ReuseMCAS>("reuse", keyRangeSize, millisToRun, totalThreads);
+        runTransferExperiment<HTMMCAS>("htm", keyRangeSize, millisToRun, totalThreads);
+    }else if(casType == 10){
+        if (keyType != 0) {
+            cout<<"ERROR: the skip vector only supports int keys (-K 0)"<<endl;
+            exit(1);
+        }
+        runExperiment<SkipVectorMCASBased<MCAS>>(keyRangeSize, millisToRun, totalThreads, insertPercent, deletePercent, rangePercent, rangeLength, bulkPrefill, useWorkload ? &workloadConfig : NULL, sampleRate);
+    }else if(casType == 11){
+        cout<<"htm="<<(HTMMCAS::rtmAvailable() ? "rtm" : "none")<<endl;
+        runTowerExperiment<HTMMCAS>(keyType, keyRangeSize, millisToRun, totalThreads, insertPercent, deletePercent, rangePercent, rangeLength, bulkPrefill, useWorkload ? &workloadConfig : NULL, sampleRate, snapshotReads);
+    }else if(casType == 12){
+        cout<<"htm="<<(HTMMCAS::rtmAvailable() ? "rtm" : "none")<<endl;
+        runMCASExperiment<HTMMCAS>(keyRangeSize, millisToRun, totalThreads, wordsPerOp);
     }else{
         std::cout <<"Wrong cas type"<<endl;
         exit(0);
@@ -1,6 +1,14 @@
+#pragma once
 #include <chrono>
+#include <cmath>
 #include <iostream>
 #include <random>
+#include <cstdio>
+#include <unistd.h>
+#include <thread>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
 
 #include "defines.h"
 
@@ -62,6 +70,106 @@ public:
     }
 } __attribute__((aligned(PADDING_BYTES)));
 
+/** cycle counter for latency sampling; falls back to steady_clock nanoseconds off x86. **/
+inline uint64_t readTSC() {
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    return chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+}
+
+/** spin-wait hint. **/
+inline void cpuRelax() {
+#if defined(__x86_64__) || defined(__i386__)
+    _mm_pause();
+#endif
+}
+
+/** readTSC ticks per nanosecond, measured once over 50ms. **/
+inline double getTicksPerNanosecond() {
+    static double ticksPerNs = 0;
+    if (ticksPerNs == 0) {
+        auto start = chrono::steady_clock::now();
+        uint64_t startTicks = readTSC();
+        this_thread::sleep_for(chrono::milliseconds(50));
+        uint64_t ticks = readTSC() - startTicks;
+        auto nanos = chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - start).count();
+        ticksPerNs = (double) ticks / nanos;
+    }
+    return ticksPerNs;
+}
+
+/**
+ * per-thread log-linear (HDR style) histogram: 16 sub-buckets per power of two, so a value is
+ * reported within about 6% of its true size. threads add to their own padded buckets and the
+ * totals are merged only when a percentile is requested.
+ **/
+class histogram {
+private:
+    static const int SUB_BITS = 4;
+    static const int MAX_EXPONENT = 44;
+    static const int NUM_BUCKETS = (MAX_EXPONENT - SUB_BITS + 1) << SUB_BITS;
+    struct PaddedBuckets {
+        volatile char padding[PADDING_BYTES];
+        long long buckets[NUM_BUCKETS];
+        long long count;
+        unsigned long long max;
+    };
+    PaddedBuckets data[MAX_THREADS+1];
+
+    static int bucketOf(unsigned long long v) {
+        if (v < (1ULL<<SUB_BITS)) return (int) v;
+        int e = 63 - __builtin_clzll(v);
+        if (e > MAX_EXPONENT) return NUM_BUCKETS - 1;
+        return ((e - SUB_BITS + 1) << SUB_BITS) + (int) ((v >> (e - SUB_BITS)) & ((1<<SUB_BITS) - 1));
+    }
+    static unsigned long long highestIn(int bucket) {
+        if (bucket < (1<<SUB_BITS)) return bucket;
+        int e = (bucket >> SUB_BITS) + SUB_BITS - 1;
+        unsigned long long low = (unsigned long long) ((1<<SUB_BITS) + (bucket & ((1<<SUB_BITS) - 1))) << (e - SUB_BITS);
+        return low + (1ULL << (e - SUB_BITS)) - 1;
+    }
+public:
+    void add(const int tid, const unsigned long long val) {
+        data[tid].buckets[bucketOf(val)]++;
+        data[tid].count++;
+        if (val > data[tid].max) data[tid].max = val;
+    }
+    long long getTotalCount() {
+        long long result = 0;
+        for (int tid=0;tid<MAX_THREADS;++tid) result += data[tid].count;
+        return result;
+    }
+    unsigned long long getMax() {
+        unsigned long long result = 0;
+        for (int tid=0;tid<MAX_THREADS;++tid) result = max(result, data[tid].max);
+        return result;
+    }
+    /** smallest value such that at least percent% of the samples are no larger (bucket upper bound). **/
+    unsigned long long getPercentile(const double percent) {
+        long long total = getTotalCount();
+        if (total == 0) return 0;
+        long long target = (long long) (percent / 100 * total + 0.999999);
+        long long seen = 0;
+        for (int b=0;b<NUM_BUCKETS;++b) {
+            for (int tid=0;tid<MAX_THREADS;++tid) seen += data[tid].buckets[b];
+            if (seen >= target) return min(highestIn(b), getMax());
+        }
+        return getMax();
+    }
+    void clear() {
+        for (int tid=0;tid<MAX_THREADS;++tid) {
+            for (int b=0;b<NUM_BUCKETS;++b) data[tid].buckets[b] = 0;
+            data[tid].count = 0;
+            data[tid].max = 0;
+        }
+    }
+    histogram() {
+        clear();
+    }
+} __attribute__((aligned(PADDING_BYTES)));
+
 class RandomNatural {
 private:
     volatile char padding[PADDING_BYTES-sizeof(unsigned int)];
@@ -85,4 +193,68 @@ public:
         seed ^= seed << 7;
         return seed;
     }
-};
\ No newline at end of file
+};
+
+#ifndef LEVEL_REFRESH_INSERTS
+#define LEVEL_REFRESH_INSERTS 256      //inserts per thread between recomputing its height cap
+#endif
+
+/**
+ * Skip list tower heights from a single xorshift64 draw. Every level above the first consumes
+ * bitsPerLevel trailing zero bits of the draw, so a tower reaches height h+1 with probability
+ * p^h where p = 2^-bitsPerLevel; other probabilities are rounded to the nearest power of two.
+ * Heights are capped at maxHeight, which the owner may lower or raise as the structure grows.
+ **/
+class RandomLevel {
+private:
+    volatile char padding0[PADDING_BYTES];
+    uint64_t state;
+    int bitsPerLevel;
+    int maxHeight;
+    int untilRefresh;
+    volatile char padding1[PADDING_BYTES];
+public:
+    RandomLevel() : state(1), bitsPerLevel(1), maxHeight(1), untilRefresh(0) {}
+
+    void init(const uint64_t seed, const double prob, const int _maxHeight) {
+        state = (seed == 0) ? 1 : seed;
+        bitsPerLevel = max(1, (int) lround(-log2(prob)));
+        maxHeight = _maxHeight;
+        untilRefresh = 0;
+    }
+    void setMaxHeight(const int h) { maxHeight = h; }
+    int getMaxHeight() const { return maxHeight; }
+    /** true once every interval calls, when the owner should recompute maxHeight. **/
+    bool refreshDue(const int interval) {
+        if (--untilRefresh > 0) return false;
+        untilRefresh = interval;
+        return true;
+    }
+
+    /** returns a height in [1, maxHeight]. **/
+    int next() {
+        state ^= state << 13;
+        state ^= state >> 7;
+        state ^= state << 17;
+        int h = 1 + __builtin_ctzll(state | (1ULL<<63)) / bitsPerLevel;
+        return h < maxHeight ? h : maxHeight;
+    }
+
+    /** levels worth building for about n keys: log_{1/p}(n) plus two, at least 1 and at most limit. **/
+    static int heightForSize(const long long n, const double prob, const int limit) {
+        int bits = max(1, (int) lround(-log2(prob)));
+        int log2n = (n > 1) ? 64 - __builtin_clzll((unsigned long long) n) : 0;
+        int h = 2 + (log2n + bits - 1) / bits;
+        return h < limit ? h : limit;
+    }
+};
+
+/** returns the resident set size of this process in KB (0 if /proc is unavailable). **/
+inline long long getResidentMemoryKB() {
+    long long pages = 0, residentPages = 0;
+    FILE *f = fopen("/proc/self/statm", "r");
+    if (f == NULL) return 0;
+    if (fscanf(f, "%lld %lld", &pages, &residentPages) != 2) residentPages = 0;
+    fclose(f);
+    return residentPages * (sysconf(_SC_PAGESIZE) / 1024);
+}
\ No newline at end of file